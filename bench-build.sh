@@ -0,0 +1,87 @@
+#!/bin/sh
+#
+# Build and startup cost of header-only and compiled Easylogger
+#
+# Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+#
+# Easylogger is free software; you can redistribute it and/or modify
+# it under the terms of the MIT license. See LICENSE for details.
+#
+# Usage: bench-build.sh [units] [runs]
+#
+# Generates a program of the given number of translation units, each
+# holding one LOG_INFO statement, and builds it twice: header-only, and
+# with EASYLOGGER_COMPILED against libeasylogger.a, which must already
+# be built.  For each build, reports the time to compile all units, the
+# number of static initializers in the program, and the mean time to
+# start and exit it over the given number of runs.
+
+set -e
+
+units=${1:-20}
+runs=${2:-200}
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:--O2}
+root=$(cd "$(dirname "$0")" && pwd)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+now() {
+	date +%s%N
+}
+
+i=0
+: > "$dir/main.cc"
+echo '#include "easylogger.h"' >> "$dir/main.cc"
+while [ $i -lt $units ]; do
+	cat > "$dir/unit$i.cc" <<UNIT
+#include "easylogger.h"
+void unit$i(easylogger::Logger& logger, int value) {
+	LOG_INFO(logger, "unit $i value " << value);
+}
+UNIT
+	echo "void unit$i(easylogger::Logger&, int);" >> "$dir/main.cc"
+	i=$((i + 1))
+done
+echo 'int main() {' >> "$dir/main.cc"
+echo '	easylogger::Logger logger("BENCH");' >> "$dir/main.cc"
+echo '	logger.Level(easylogger::LEVEL_NONE);' >> "$dir/main.cc"
+i=0
+while [ $i -lt $units ]; do
+	echo "	unit$i(logger, $i);" >> "$dir/main.cc"
+	i=$((i + 1))
+done
+echo '	return 0;' >> "$dir/main.cc"
+echo '}' >> "$dir/main.cc"
+
+printf "%u units, %u runs\n" "$units" "$runs"
+printf "%-10s %12s %14s %12s\n" "" "compile ms" "initializers" "startup us"
+for mode in header compiled; do
+	if [ $mode = compiled ]; then
+		flags=-DEASYLOGGER_COMPILED
+		lib="$root/libeasylogger.a"
+	else
+		flags=
+		lib=
+	fi
+
+	start=$(now)
+	for unit in "$dir"/*.cc; do
+		$CXX $CXXFLAGS $flags -I"$root" -c -o "${unit%.cc}.o" "$unit"
+	done
+	compile=$((($(now) - start) / 1000000))
+	$CXX -pthread -o "$dir/prog" "$dir"/*.o $lib -ldl
+
+	initializers=$(size -A -d "$dir/prog" | awk '$1 == ".init_array" { print $2 / 8 }')
+
+	start=$(now)
+	i=0
+	while [ $i -lt $runs ]; do
+		"$dir/prog"
+		i=$((i + 1))
+	done
+	startup=$((($(now) - start) / 1000 / runs))
+
+	printf "%-10s %12u %14u %12u\n" $mode $compile "${initializers:-0}" $startup
+	rm -f "$dir"/*.o
+done
@@ -0,0 +1,241 @@
+//! \file bench-latency.cc
+//!
+//! Per-call latency benchmark for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Usage: bench-latency [threads] [rate] [seconds]
+//!
+//! Drives LOG_INFO from a number of producer threads, each issuing
+//! calls on a fixed schedule so that together they reach the target
+//! rate in calls per second.  Every call's latency is recorded into an
+//! HDR histogram twice: once as service time, measured from the actual
+//! start of the call, and once as response time, measured from the
+//! time the call was scheduled to start.  A call that stalls delays
+//! the calls queued behind it; the response time histogram counts that
+//! delay, correcting the coordinated omission that hides stalls from
+//! service time measurements.
+//!
+//! Each producer logs to its own Logger and output, since a Logger
+//! writing to a shared stream is not thread-safe.
+
+#include "easylogger-async.h"
+#include "easylogger-file.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	typedef ::std::chrono::steady_clock Clock;
+
+	//! High dynamic range histogram of nanosecond values
+	//!
+	//! Values are grouped by their highest set bit, and each group is
+	//! split into SUB_BUCKETS linear buckets, which keeps the relative
+	//! error of every recorded value below 1/SUB_BUCKETS.
+	class Histogram {
+	public:
+		//! Buckets per power of two; gives ~3 significant digits
+		enum { SUB_BITS = 10, SUB_BUCKETS = 1 << SUB_BITS, HALF = SUB_BUCKETS / 2 };
+
+		Histogram() : _counts((64 - SUB_BITS + 2) * HALF, 0), _total(0),
+				_max(0) {}
+
+		//! Record a single value
+		void Record(unsigned long long value) {
+			++_counts[Index(value)];
+			++_total;
+			if (value > _max) {
+				_max = value;
+			}
+		}
+
+		//! Add all values of another histogram
+		void Merge(const Histogram& other) {
+			for (::std::size_t i = 0; i != _counts.size(); ++i) {
+				_counts[i] += other._counts[i];
+			}
+			_total += other._total;
+			if (other._max > _max) {
+				_max = other._max;
+			}
+		}
+
+		//! Get the value at a percentile
+		//!
+		//! \param percentile Percentile between 0 and 100.
+		//! \returns Highest value of the bucket holding the percentile
+		unsigned long long Percentile(double percentile) const {
+			const unsigned long long rank = static_cast<unsigned long long>(
+					::std::ceil(percentile / 100.0 * _total));
+			unsigned long long seen = 0;
+			for (::std::size_t i = 0; i != _counts.size(); ++i) {
+				seen += _counts[i];
+				if (seen >= rank && seen != 0) {
+					const unsigned long long high = Highest(i);
+					return high < _max ? high : _max;
+				}
+			}
+			return _max;
+		}
+
+		unsigned long long Max() const { return _max; }
+
+		unsigned long long Total() const { return _total; }
+
+	private:
+		//! Values below SUB_BUCKETS map to themselves; above, each
+		//! doubling of the value adds HALF buckets
+		static ::std::size_t Index(unsigned long long value) {
+			if (value < SUB_BUCKETS) {
+				return static_cast< ::std::size_t>(value);
+			}
+			const unsigned int shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1);
+			return shift * HALF + static_cast< ::std::size_t>(value >> shift);
+		}
+
+		//! Highest value mapping to a bucket
+		static unsigned long long Highest(::std::size_t index) {
+			if (index < SUB_BUCKETS) {
+				return index;
+			}
+			const unsigned int shift = index / HALF - 1;
+			const unsigned long long sub = index - shift * HALF;
+			return ((sub + 1) << shift) - 1;
+		}
+
+		::std::vector<unsigned long long> _counts;
+
+		unsigned long long _total;
+
+		unsigned long long _max;
+	};
+
+	//! Output a producer logs to
+	enum Output {
+		OUTPUT_NULL,		//!< std::ofstream on /dev/null
+		OUTPUT_OFSTREAM,	//!< std::ofstream on a file
+		OUTPUT_FILESINK,	//!< FileSink on a file
+		OUTPUT_ASYNC_SPIN,	//!< AsyncSink with WAKE_SPIN over a FileSink
+		OUTPUT_ASYNC_SLEEP,	//!< AsyncSink with WAKE_SPIN_SLEEP over a FileSink
+		OUTPUT_ASYNC_TIMED	//!< AsyncSink with WAKE_TIMED over a FileSink
+	};
+
+	const char* const OUTPUT_NAMES[] = { "ostream-null", "ostream-file",
+			"filesink", "async-spin", "async-sleep", "async-timed" };
+
+	//! Latencies recorded by one producer
+	struct Result {
+		Histogram service;
+		Histogram response;
+	};
+
+	//! Log at a fixed rate until the deadline, recording latencies
+	void Produce(Output output, unsigned int id, double rate,
+			Clock::time_point start, Clock::time_point end, Result& result) {
+		char path[64];
+		::std::snprintf(path, sizeof(path), "bench-latency-%u.log", id);
+
+		::std::remove(path);
+		::std::ofstream stream(output == OUTPUT_OFSTREAM ? path : "/dev/null");
+		easylogger::FileSink sink(output >= OUTPUT_FILESINK ? path : "/dev/null");
+		::std::unique_ptr<easylogger::AsyncSink> async;
+		if (output >= OUTPUT_ASYNC_SPIN) {
+			const easylogger::WakeStrategy strategies[] = { easylogger::WAKE_SPIN,
+					easylogger::WAKE_SPIN_SLEEP, easylogger::WAKE_TIMED };
+			async.reset(new easylogger::AsyncSink(sink,
+					strategies[output - OUTPUT_ASYNC_SPIN],
+					::std::chrono::microseconds(output == OUTPUT_ASYNC_TIMED ?
+					1000 : 50)));
+		}
+		easylogger::Logger logger("BENCH");
+		if (output >= OUTPUT_FILESINK) {
+			logger.DetachStream();
+			logger.Output(async ? static_cast<easylogger::Sink&>(*async) : sink);
+		} else {
+			logger.Stream(stream);
+		}
+
+		const Clock::duration interval = ::std::chrono::duration_cast<
+				Clock::duration>(::std::chrono::duration<double>(1.0 / rate));
+		Clock::time_point scheduled = start;
+		for (unsigned long long i = 0; scheduled < end; ++i) {
+			while (Clock::now() < scheduled) {
+			}
+
+			const Clock::time_point begin = Clock::now();
+			LOG_INFO(logger, "request " << i << " from producer " << id
+					<< " completed in " << 42 << "us");
+			const Clock::time_point done = Clock::now();
+
+			result.service.Record(::std::chrono::duration_cast<
+					::std::chrono::nanoseconds>(done - begin).count());
+			result.response.Record(::std::chrono::duration_cast<
+					::std::chrono::nanoseconds>(done - scheduled).count());
+			scheduled += interval;
+		}
+
+		logger.DetachOutput();
+		async.reset();
+		::std::remove(path);
+	}
+
+	void Report(const char* name, const Histogram& histogram) {
+		::std::printf("  %-9s %10llu %10llu %10llu %10llu %10llu %10llu\n",
+				name, histogram.Total(), histogram.Percentile(50),
+				histogram.Percentile(99), histogram.Percentile(99.9),
+				histogram.Percentile(99.99), histogram.Max());
+	}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	const unsigned int threads = argc > 1 ? ::std::atoi(argv[1]) : 2;
+	const double rate = argc > 2 ? ::std::atof(argv[2]) : 100000;
+	const double seconds = argc > 3 ? ::std::atof(argv[3]) : 2;
+	if (threads == 0 || rate <= 0 || seconds <= 0) {
+		::std::fprintf(stderr, "usage: %s [threads] [rate] [seconds]\n", argv[0]);
+		return 1;
+	}
+
+	::std::printf("%u threads, %.0f calls/s total, %.1fs per output; "
+			"latencies in ns\n", threads, rate, seconds);
+	::std::printf("  %-9s %10s %10s %10s %10s %10s %10s\n", "", "calls", "p50",
+			"p99", "p99.9", "p99.99", "max");
+
+	for (unsigned int output = OUTPUT_NULL; output <= OUTPUT_ASYNC_TIMED;
+			++output) {
+		::std::vector<Result> results(threads);
+		::std::vector< ::std::thread> producers;
+		const Clock::time_point start = Clock::now() +
+				::std::chrono::milliseconds(50);
+		const Clock::time_point end = start + ::std::chrono::duration_cast<
+				Clock::duration>(::std::chrono::duration<double>(seconds));
+		for (unsigned int i = 0; i != threads; ++i) {
+			producers.push_back(::std::thread(Produce,
+					static_cast<Output>(output), i, rate / threads, start, end,
+					::std::ref(results[i])));
+		}
+
+		Result total;
+		for (unsigned int i = 0; i != threads; ++i) {
+			producers[i].join();
+			total.service.Merge(results[i].service);
+			total.response.Merge(results[i].response);
+		}
+
+		::std::printf("%s\n", OUTPUT_NAMES[output]);
+		Report("service", total.service);
+		Report("response", total.response);
+	}
+
+	return 0;
+}
@@ -0,0 +1,391 @@
+//! \file bench.cc
+//!
+//! Hot path benchmarks for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Usage: bench [--perf] [--json FILE] [--compare BASELINE]
+//!         [--tolerance PERCENT]
+//!
+//! Measures the cost of a disabled log call, the cost of an enabled log
+//! call formatting into a discarding stream, and the throughput of
+//! records written through a FileSink.  Each benchmark runs several
+//! times; the median and the median absolute deviation (MAD) of the
+//! runs are reported, and written as JSON with --json.
+//!
+//! With --compare, the results are checked against a baseline written
+//! by an earlier --json run.  A benchmark regresses when it is worse
+//! than the baseline by more than both the tolerance (default 10%) and
+//! three times the combined MAD of the two runs, so noisy benchmarks
+//! need a larger difference to fail.  The exit status is 1 if any
+//! benchmark regressed.
+//!
+//! With --perf, hardware counters are read with perf_event_open()
+//! around each run, and instructions, cycles, cache misses and branch
+//! misses per operation are reported as additional benchmarks.
+//! Instructions per operation hardly vary between runs, which makes
+//! them the most reliable results on shared machines.  If the counters
+//! cannot be opened, for example because of perf_event_paranoid or a
+//! container, a warning is printed and they are skipped.
+
+#include "easylogger-file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+namespace {
+
+	typedef ::std::chrono::steady_clock Clock;
+
+	//! Number of runs of each benchmark
+	const unsigned int RUNS = 7;
+
+	//! Stream buffer discarding everything written to it
+	class NullBuf : public ::std::streambuf {
+	protected:
+		int overflow(int c) { return c; }
+
+		::std::streamsize xsputn(const char*, ::std::streamsize n) { return n; }
+	};
+
+	//! Group of hardware performance counters on the calling thread
+	class PerfCounters {
+	public:
+		//! Counters read, in order
+		enum { INSTRUCTIONS, CYCLES, CACHE_MISSES, BRANCH_MISSES, COUNT };
+
+		PerfCounters() : _enabled(false) {
+			for (unsigned int i = 0; i != COUNT; ++i) {
+				_fds[i] = -1;
+				_per_op[i] = 0;
+			}
+		}
+
+		~PerfCounters() {
+			for (unsigned int i = 0; i != COUNT; ++i) {
+				if (_fds[i] >= 0) {
+					::close(_fds[i]);
+				}
+			}
+		}
+
+		//! Open the counters
+		//!
+		//! \returns false if any counter is unavailable
+		bool Open() {
+#if defined(__linux__)
+			static const unsigned long long configs[COUNT] = {
+				PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CPU_CYCLES,
+				PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+			};
+			for (unsigned int i = 0; i != COUNT; ++i) {
+				struct perf_event_attr attr;
+				::std::memset(&attr, 0, sizeof(attr));
+				attr.size = sizeof(attr);
+				attr.type = PERF_TYPE_HARDWARE;
+				attr.config = configs[i];
+				attr.disabled = i == 0;
+				attr.exclude_kernel = 1;
+				attr.exclude_hv = 1;
+				attr.read_format = PERF_FORMAT_GROUP;
+				_fds[i] = ::syscall(SYS_perf_event_open, &attr, 0, -1,
+						i == 0 ? -1 : _fds[0], 0);
+				if (_fds[i] < 0) {
+					return false;
+				}
+			}
+			_enabled = true;
+#endif
+			return _enabled;
+		}
+
+		bool Enabled() const { return _enabled; }
+
+		//! Reset and start counting
+		void Start() {
+#if defined(__linux__)
+			if (_enabled) {
+				::ioctl(_fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+				::ioctl(_fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			}
+#endif
+		}
+
+		//! Stop counting and compute counts per operation
+		//!
+		//! \param operations Operations performed since Start().
+		void Stop(unsigned long operations) {
+#if defined(__linux__)
+			if (_enabled) {
+				::ioctl(_fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+				unsigned long long values[1 + COUNT];
+				if (::read(_fds[0], values, sizeof(values)) ==
+						static_cast<ssize_t>(sizeof(values))) {
+					for (unsigned int i = 0; i != COUNT; ++i) {
+						_per_op[i] = static_cast<double>(values[1 + i]) / operations;
+					}
+				}
+			}
+#else
+			(void)operations;
+#endif
+		}
+
+		//! Get a counter per operation of the last run
+		double PerOp(unsigned int counter) const { return _per_op[counter]; }
+
+	private:
+		bool _enabled;
+
+		int _fds[COUNT];
+
+		double _per_op[COUNT];
+	};
+
+	//! Result of one benchmark
+	struct Result {
+		const char* name;	//!< Name of benchmark
+		const char* unit;	//!< Unit of values
+		bool higher;		//!< true if higher values are better
+		double median;		//!< Median of runs
+		double mad;			//!< Median absolute deviation of runs
+	};
+
+	double Median(::std::vector<double> values) {
+		::std::sort(values.begin(), values.end());
+		const ::std::size_t middle = values.size() / 2;
+		return values.size() % 2 != 0 ? values[middle] :
+				(values[middle - 1] + values[middle]) / 2;
+	}
+
+	//! Summarize the runs of a benchmark
+	Result Summarize(const char* name, const char* unit, bool higher,
+			const ::std::vector<double>& runs) {
+		Result result = { name, unit, higher, Median(runs), 0 };
+		::std::vector<double> deviations;
+		for (::std::size_t i = 0; i != runs.size(); ++i) {
+			deviations.push_back(::std::fabs(runs[i] - result.median));
+		}
+		result.mad = Median(deviations);
+		return result;
+	}
+
+	double Seconds(Clock::time_point start) {
+		return ::std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	//! Nanoseconds per LOG_DEBUG call on a Logger at LEVEL_INFO
+	double DisabledCall(easylogger::Logger& logger, PerfCounters& perf) {
+		const unsigned long iterations = 20000000;
+		const Clock::time_point start = Clock::now();
+		perf.Start();
+		for (unsigned long i = 0; i != iterations; ++i) {
+			LOG_DEBUG(logger, "disabled " << i);
+			// keep the level check inside the loop
+			__asm__ __volatile__ ("" ::: "memory");
+		}
+		perf.Stop(iterations);
+		return Seconds(start) * 1e9 / iterations;
+	}
+
+	//! Nanoseconds per LOG_INFO call formatted into a discarding stream
+	double EnabledCall(easylogger::Logger& logger, PerfCounters& perf) {
+		const unsigned long iterations = 500000;
+		const Clock::time_point start = Clock::now();
+		perf.Start();
+		for (unsigned long i = 0; i != iterations; ++i) {
+			LOG_INFO(logger, "enabled " << i << " of " << iterations);
+		}
+		perf.Stop(iterations);
+		return Seconds(start) * 1e9 / iterations;
+	}
+
+	//! Records per second written to a file through a FileSink
+	double Throughput(easylogger::Logger& logger, PerfCounters& perf) {
+		const unsigned long iterations = 200000;
+		const Clock::time_point start = Clock::now();
+		perf.Start();
+		for (unsigned long i = 0; i != iterations; ++i) {
+			LOG_INFO(logger, "record " << i << " of " << iterations);
+		}
+		perf.Stop(iterations);
+		return iterations / Seconds(start);
+	}
+
+	void WriteJson(::std::ostream& os, const ::std::vector<Result>& results) {
+		os << "{\n";
+		for (::std::size_t i = 0; i != results.size(); ++i) {
+			os << "  \"" << results[i].name << "\": { \"median\": "
+					<< results[i].median << ", \"mad\": " << results[i].mad
+					<< ", \"unit\": \"" << results[i].unit << "\" }"
+					<< (i + 1 != results.size() ? ",\n" : "\n");
+		}
+		os << "}\n";
+	}
+
+	//! Find a number following a key after a position in a JSON text
+	bool ReadNumber(const ::std::string& json, ::std::string::size_type from,
+			const char* key, double& value) {
+		const ::std::string::size_type at = json.find(key, from);
+		if (at == ::std::string::npos) {
+			return false;
+		}
+		const ::std::string::size_type colon = json.find(':', at);
+		return colon != ::std::string::npos &&
+				::std::sscanf(json.c_str() + colon + 1, "%lf", &value) == 1;
+	}
+
+	//! Compare results against a baseline; returns number of regressions
+	int Compare(const char* path, const ::std::vector<Result>& results,
+			double tolerance) {
+		::std::ifstream file(path);
+		if (!file) {
+			::std::fprintf(stderr, "cannot read baseline %s\n", path);
+			return -1;
+		}
+		const ::std::string json((::std::istreambuf_iterator<char>(file)),
+				::std::istreambuf_iterator<char>());
+
+		int regressions = 0;
+		for (::std::size_t i = 0; i != results.size(); ++i) {
+			const Result& result = results[i];
+			const ::std::string key = ::std::string("\"") + result.name + "\"";
+			const ::std::string::size_type at = json.find(key);
+			double median = 0;
+			double mad = 0;
+			if (at == ::std::string::npos ||
+					!ReadNumber(json, at, "\"median\"", median) ||
+					!ReadNumber(json, at, "\"mad\"", mad)) {
+				::std::printf("%-24s missing from baseline\n", result.name);
+				continue;
+			}
+
+			const double worse = result.higher ? median - result.median :
+					result.median - median;
+			const double allowed = ::std::max(median * tolerance / 100,
+					3 * (mad + result.mad));
+			const bool regressed = worse > allowed;
+			::std::printf("%-24s %12.3f -> %12.3f %-10s %+7.1f%% %s\n",
+					result.name, median, result.median, result.unit,
+					median != 0 ? (result.median - median) * 100 / median : 0,
+					regressed ? "REGRESSED" : "ok");
+			regressions += regressed ? 1 : 0;
+		}
+		return regressions;
+	}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+	const char* json = 0;
+	const char* baseline = 0;
+	double tolerance = 10;
+	bool counters = false;
+	for (int i = 1; i < argc; ++i) {
+		if (::std::strcmp(argv[i], "--perf") == 0) {
+			counters = true;
+		} else if (::std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			json = argv[++i];
+		} else if (::std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+			baseline = argv[++i];
+		} else if (::std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = ::std::atof(argv[++i]);
+		} else {
+			::std::fprintf(stderr, "usage: %s [--perf] [--json FILE] "
+					"[--compare BASELINE] [--tolerance PERCENT]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	NullBuf null_buf;
+	::std::ostream null_stream(&null_buf);
+	easylogger::Logger memory("BENCH");
+	memory.Stream(null_stream);
+
+	easylogger::FileSink sink("bench-output.log");
+	easylogger::Logger file("BENCH");
+	file.DetachStream();
+	file.Output(sink);
+
+	PerfCounters perf;
+	if (counters && !perf.Open()) {
+		::std::fprintf(stderr, "warning: hardware counters unavailable; "
+				"check /proc/sys/kernel/perf_event_paranoid\n");
+	}
+
+	// times, then counters per operation, of each benchmark and run
+	static const char* const names[3] = { "disabled_call", "enabled_call",
+			"filesink_throughput" };
+	static const char* const counter_names[PerfCounters::COUNT] = {
+			"instructions", "cycles", "cache_misses", "branch_misses" };
+	::std::vector<double> times[3];
+	::std::vector<double> counts[3][PerfCounters::COUNT];
+	for (unsigned int run = 0; run != RUNS; ++run) {
+		for (unsigned int bench = 0; bench != 3; ++bench) {
+			times[bench].push_back(bench == 0 ? DisabledCall(memory, perf) :
+					bench == 1 ? EnabledCall(memory, perf) :
+					Throughput(file, perf));
+			for (unsigned int i = 0; i != PerfCounters::COUNT; ++i) {
+				counts[bench][i].push_back(perf.PerOp(i));
+			}
+		}
+	}
+	::std::remove("bench-output.log");
+
+	::std::vector<Result> results;
+	results.push_back(Summarize(names[0], "ns/call", false, times[0]));
+	results.push_back(Summarize(names[1], "ns/call", false, times[1]));
+	results.push_back(Summarize(names[2], "records/s", true, times[2]));
+
+	// names of counter results must outlive the results
+	::std::vector< ::std::string> counter_results;
+	counter_results.reserve(3 * PerfCounters::COUNT);
+	if (perf.Enabled()) {
+		for (unsigned int bench = 0; bench != 3; ++bench) {
+			for (unsigned int i = 0; i != PerfCounters::COUNT; ++i) {
+				counter_results.push_back(::std::string(names[bench]) + "_" +
+						counter_names[i]);
+				results.push_back(Summarize(counter_results.back().c_str(),
+						"per op", false, counts[bench][i]));
+			}
+		}
+	}
+
+	for (::std::size_t i = 0; i != results.size(); ++i) {
+		::std::printf("%-24s %12.3f %-10s (MAD %.3f)\n", results[i].name,
+				results[i].median, results[i].unit, results[i].mad);
+	}
+
+	if (json != 0) {
+		::std::ofstream out(json);
+		WriteJson(out, results);
+	}
+
+	if (baseline != 0) {
+		::std::printf("\ncompared to %s:\n", baseline);
+		const int regressions = Compare(baseline, results, tolerance);
+		if (regressions != 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+//! \file easylogger-async.h
+//!
+//! Background writer sink for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_ASYNC_H)
+#define EASYLOGGER_ASYNC_H
+
+#include "easylogger.h"
+
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <time.h>
+# include <unistd.h>
+#endif
+
+namespace easylogger {
+
+	//! How a background writer waits for work
+	enum WakeStrategy {
+		WAKE_SPIN,			//!< Busy-spin; lowest latency, burns a core
+		WAKE_SPIN_SLEEP,	//!< Spin for a while, then sleep until signalled
+		WAKE_TIMED			//!< Wake periodically; producers never signal
+	};
+
+	//! Private namespace
+	//! \internal
+	namespace _private {
+
+		//! Wake-up point between producers and a background writer
+		//!
+		//! Producers call Ring() after publishing work.  It costs a
+		//! fence and a load, and only makes a system call when the
+		//! writer has announced that it is going to sleep.  The writer
+		//! announces this, then checks for work once more before
+		//! sleeping, so a Ring() is never missed.  Several writers may
+		//! wait on one doorbell; Wake() wakes all of them.
+		//!
+		//! \internal
+		class Doorbell {
+		public:
+			Doorbell() : _word(0), _sleepers(0) {}
+
+			//! Signal the writers if any is asleep
+			void Ring() {
+				::std::atomic_thread_fence(::std::memory_order_seq_cst);
+				if (_sleepers.load(::std::memory_order_relaxed) != 0) {
+					Wake();
+				}
+			}
+
+			//! Signal the writers unconditionally
+			inline void Wake();
+
+			//! Wait until work is ready
+			//!
+			//! May return before ready() is true, after the interval or
+			//! on a wake-up, so callers loop.
+			//!
+			//! \param strategy How to wait.
+			//! \param interval Spin time for WAKE_SPIN_SLEEP, or sleep
+			//! time for WAKE_TIMED.
+			//! \param ready Returns true once there is work.
+			template <typename Ready>
+			void Wait(WakeStrategy strategy, ::std::chrono::microseconds interval,
+					Ready ready);
+
+			//! Pause briefly inside a spin loop
+			static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+				__builtin_ia32_pause();
+#endif
+			}
+
+		private:
+			Doorbell(const Doorbell&);
+			Doorbell& operator=(const Doorbell&);
+
+			//! Sleep while the word is unchanged, up to a timeout
+			inline void Sleep(unsigned int word,
+					::std::chrono::microseconds timeout);
+
+			//! Bumped by each Wake(); the futex word
+			::std::atomic<unsigned int> _word;
+
+			//! Writers announced as going to sleep
+			::std::atomic<unsigned int> _sleepers;
+
+#if !defined(__linux__)
+			::std::mutex _lock;
+
+			::std::condition_variable _wake;
+#endif
+		};
+
+		void Doorbell::Wake() {
+#if defined(__linux__)
+			_word.fetch_add(1, ::std::memory_order_release);
+			::syscall(SYS_futex, reinterpret_cast<unsigned int*>(&_word),
+					FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+#else
+			{
+				::std::lock_guard< ::std::mutex> guard(_lock);
+				_word.fetch_add(1, ::std::memory_order_release);
+			}
+			_wake.notify_all();
+#endif
+		}
+
+		void Doorbell::Sleep(unsigned int word,
+				::std::chrono::microseconds timeout) {
+#if defined(__linux__)
+			struct timespec ts;
+			ts.tv_sec = timeout.count() / 1000000;
+			ts.tv_nsec = timeout.count() % 1000000 * 1000;
+			::syscall(SYS_futex, reinterpret_cast<unsigned int*>(&_word),
+					FUTEX_WAIT_PRIVATE, word, &ts, 0, 0);
+#else
+			::std::unique_lock< ::std::mutex> guard(_lock);
+			_wake.wait_for(guard, timeout, [this, word] {
+				return _word.load(::std::memory_order_relaxed) != word;
+			});
+#endif
+		}
+
+		template <typename Ready>
+		void Doorbell::Wait(WakeStrategy strategy,
+				::std::chrono::microseconds interval, Ready ready) {
+			if (strategy == WAKE_TIMED) {
+				// only Wake() from a producer finding no space cuts this short
+				Sleep(_word.load(::std::memory_order_acquire), interval);
+				return;
+			}
+
+			const ::std::chrono::steady_clock::time_point until =
+					::std::chrono::steady_clock::now() + interval;
+			for (unsigned int spins = 1; !ready(); ++spins) {
+				if (strategy == WAKE_SPIN_SLEEP && spins % 64 == 0 &&
+						::std::chrono::steady_clock::now() >= until) {
+					const unsigned int word = _word.load(::std::memory_order_acquire);
+					_sleepers.fetch_add(1, ::std::memory_order_relaxed);
+					::std::atomic_thread_fence(::std::memory_order_seq_cst);
+					if (!ready()) {
+						Sleep(word, ::std::chrono::milliseconds(100));
+					}
+					_sleepers.fetch_sub(1, ::std::memory_order_relaxed);
+					return;
+				}
+				Pause();
+			}
+		}
+
+		//! Round a queue capacity up to a power of two
+		//!
+		//! \internal
+		//! \param capacity Requested number of slots.
+		//! \param minimum Smallest number of slots, a power of two.
+		//! \returns Number of slots to use
+		inline ::std::size_t QueueCapacity(::std::size_t capacity,
+				::std::size_t minimum) {
+			::std::size_t slots = minimum;
+			while (slots < capacity) {
+				slots *= 2;
+			}
+			return slots;
+		}
+
+	} // namespace _private
+
+	//! Sink handing records to a background thread
+	//!
+	//! Write() copies the record into a bounded lock-free queue and
+	//! returns; a writer thread passes queued records to the wrapped
+	//! sink in the order they were queued.  When the queue is full,
+	//! Write() wakes the writer and waits for space, so no record is
+	//! lost.
+	//!
+	//! The wake strategy trades latency for CPU time.  WAKE_SPIN keeps
+	//! the writer spinning on the queue.  WAKE_SPIN_SLEEP spins for the
+	//! interval after the last record, then sleeps until a producer
+	//! signals it; producers only make a system call to do so while the
+	//! writer sleeps.  WAKE_TIMED has the writer drain the queue once
+	//! per interval and producers never signal, which batches records
+	//! at the cost of up to one interval of delay.
+	//!
+	//! As with FailoverSink, records reach the wrapped sink with a
+	//! stand-in Logger carrying the original's name, and without
+	//! backtrace frames.
+	//!
+	//! The sink may be shared by Loggers writing from several threads;
+	//! the wrapped sink is only used by the writer thread.
+	class AsyncSink : public Sink {
+	public:
+		//! Construct a new sink and start its writer thread
+		//!
+		//! \param sink Sink to write records to.
+		//! \param strategy How the writer waits for records.
+		//! \param interval Spin time for WAKE_SPIN_SLEEP, or drain
+		//! period for WAKE_TIMED.
+		//! \param capacity Records the queue holds; rounded up to a power
+		//! of two.
+		inline explicit AsyncSink(Sink& sink,
+				WakeStrategy strategy = WAKE_SPIN_SLEEP,
+				::std::chrono::microseconds interval =
+						::std::chrono::microseconds(50),
+				::std::size_t capacity = 8192);
+
+		//! Write all queued records and stop the writer thread
+		inline ~AsyncSink();
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		//! Wait for queued records to be written, then flush the sink
+		inline void Flush();
+
+	private:
+		AsyncSink(const AsyncSink&);
+		AsyncSink& operator=(const AsyncSink&);
+
+		//! A queued record
+		struct Slot {
+			//! Position the slot is ready for: pos when free, pos + 1
+			//! when holding the record queued at pos
+			::std::atomic< ::std::size_t> sequence;
+			LogLevel level;
+			//! Copy of the Logger name, which may be borrowed
+			::std::string name;
+			const char* file;
+			unsigned int line;
+			const char* func;
+			const char* format;
+			//! Formatted text followed by the message
+			::std::string data;
+			::std::size_t length;
+		};
+
+		//! Check if the slot at the head holds a record
+		bool Ready() const {
+			return _slots[_head.load(::std::memory_order_relaxed) & _mask]
+					.sequence.load(::std::memory_order_acquire) ==
+					_head.load(::std::memory_order_relaxed) + 1;
+		}
+
+		//! Writer thread body
+		inline void Run();
+
+		//! Flush the sink if a flush the writer has reached is pending
+		inline void CheckFlush(::std::size_t head);
+
+		Sink& _sink;
+
+		WakeStrategy _strategy;
+
+		::std::chrono::microseconds _interval;
+
+		::std::vector<Slot> _slots;
+
+		::std::size_t _mask;
+
+		//! Next position to queue at
+		::std::atomic< ::std::size_t> _tail;
+
+		//! Next position to write from; only the writer changes it
+		::std::atomic< ::std::size_t> _head;
+
+		_private::Doorbell _doorbell;
+
+		::std::atomic<bool> _running;
+
+		//! Queue position Flush() waits for
+		::std::atomic< ::std::size_t> _flush_request;
+
+		::std::mutex _flush_lock;
+
+		::std::condition_variable _flushed;
+
+		//! Queue position up to which the sink was last flushed; only
+		//! the writer changes it
+		::std::size_t _flush_done;
+
+		::std::thread _thread;
+	};
+
+	AsyncSink::AsyncSink(Sink& sink, WakeStrategy strategy,
+			::std::chrono::microseconds interval, ::std::size_t capacity) :
+			_sink(sink), _strategy(strategy), _interval(interval),
+			_slots(_private::QueueCapacity(capacity, 2)),
+			_mask(_slots.size() - 1), _tail(0), _head(0), _running(true),
+			_flush_request(0), _flush_done(0) {
+		for (::std::size_t i = 0; i != _slots.size(); ++i) {
+			_slots[i].sequence.store(i, ::std::memory_order_relaxed);
+		}
+		_thread = ::std::thread(&AsyncSink::Run, this);
+	}
+
+	AsyncSink::~AsyncSink() {
+		_running.store(false, ::std::memory_order_release);
+		_doorbell.Wake();
+		_thread.join();
+	}
+
+	bool AsyncSink::Write(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		::std::size_t pos = _tail.load(::std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &_slots[pos & _mask];
+			const ::std::size_t sequence = slot->sequence.load(
+					::std::memory_order_acquire);
+			if (sequence == pos) {
+				if (_tail.compare_exchange_weak(pos, pos + 1,
+						::std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (sequence < pos) {
+				// full; the writer may be asleep whatever the strategy
+				_doorbell.Wake();
+				::std::this_thread::yield();
+				pos = _tail.load(::std::memory_order_relaxed);
+			} else {
+				pos = _tail.load(::std::memory_order_relaxed);
+			}
+		}
+
+		slot->level = record.level;
+		slot->name.assign(record.logger->Name());
+		slot->file = record.file;
+		slot->line = record.line;
+		slot->func = record.func;
+		slot->format = record.format;
+		slot->data.assign(text, length);
+		slot->data.append(record.message);
+		slot->length = length;
+		slot->sequence.store(pos + 1, ::std::memory_order_release);
+
+		_doorbell.Ring();
+		return true;
+	}
+
+	void AsyncSink::Flush() {
+		const ::std::size_t target = _tail.load(::std::memory_order_acquire);
+		::std::unique_lock< ::std::mutex> guard(_flush_lock);
+		if (target > _flush_request.load(::std::memory_order_relaxed)) {
+			_flush_request.store(target, ::std::memory_order_release);
+		}
+		_doorbell.Wake();
+		while (_flush_done < target) {
+			_flushed.wait_for(guard, ::std::chrono::milliseconds(1));
+			_doorbell.Wake();
+		}
+	}
+
+	void AsyncSink::Run() {
+		for (;;) {
+			while (Ready()) {
+				const ::std::size_t head = _head.load(::std::memory_order_relaxed);
+				Slot& slot = _slots[head & _mask];
+				const Logger standin(slot.name.c_str());
+				const LogRecord record = { slot.level, &standin, slot.file,
+						slot.line, slot.func, slot.data.c_str() + slot.length, 0, 0,
+						slot.format };
+				_sink.Write(record, slot.data.data(), slot.length);
+
+				slot.sequence.store(head + _slots.size(),
+						::std::memory_order_release);
+				_head.store(head + 1, ::std::memory_order_release);
+				// a flush must not wait for producers to pause
+				CheckFlush(head + 1);
+			}
+			CheckFlush(_head.load(::std::memory_order_relaxed));
+
+			if (!_running.load(::std::memory_order_acquire) && !Ready()) {
+				break;
+			}
+			_doorbell.Wait(_strategy, _interval, [this] {
+				return Ready() || !_running.load(::std::memory_order_relaxed);
+			});
+		}
+		_sink.Flush();
+	}
+
+	void AsyncSink::CheckFlush(::std::size_t head) {
+		const ::std::size_t request = _flush_request.load(
+				::std::memory_order_acquire);
+		if (request == 0 || head < request || _flush_done >= request) {
+			return;
+		}
+		::std::lock_guard< ::std::mutex> guard(_flush_lock);
+		_sink.Flush();
+		_flush_done = head;
+		_flushed.notify_all();
+	}
+
+} // namespace easylogger
+
+#endif
@@ -0,0 +1,418 @@
+//! \file easylogger-failover.h
+//!
+//! Failover sink for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_FAILOVER_H)
+#define EASYLOGGER_FAILOVER_H
+
+#include "easylogger.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace easylogger {
+
+	//! Sink writing records to a std::ostream
+	//!
+	//! Lets a stream, such as a pipe or a file on a network mount, be
+	//! used where a Sink is needed, for example behind a FailoverSink.
+	//! A failed write clears the stream's error state, so later writes
+	//! are attempted again.
+	class StreamSink : public Sink {
+	public:
+		//! Construct a new sink
+		//!
+		//! \param stream Stream to write to; it must outlive the sink.
+		explicit StreamSink(::std::ostream& stream) : _stream(stream) {}
+
+		bool Write(const LogRecord&, const char* text, ::std::size_t length) {
+			_stream.write(text, length);
+			if (!_stream) {
+				_stream.clear();
+				return false;
+			}
+			return true;
+		}
+
+		void Flush() { _stream.flush(); }
+
+	private:
+		StreamSink(const StreamSink&);
+		StreamSink& operator=(const StreamSink&);
+
+		::std::ostream& _stream;
+	};
+
+	//! Sink failing over to a fallback when its primary sink stalls
+	//!
+	//! Records are written to the primary sink, one thread at a time.
+	//! The primary is considered failed when a write takes longer than
+	//! the deadline, when a thread waits longer than the deadline for
+	//! another thread's write to finish, or after a number of writes in
+	//! a row return false.  A thread stuck in a write to a hung primary
+	//! stays stuck until the write returns, but every other thread
+	//! fails over after at most one deadline.
+	//!
+	//! While failed over, records go to the fallback sink, if any, and
+	//! are spilled into a bounded memory ring.  A watchdog thread tries
+	//! the primary again periodically by replaying the spilled records
+	//! in order; once all are written within the deadline, records go
+	//! to the primary again.  When the ring is full, the oldest spilled
+	//! records are discarded and counted.
+	//!
+	//! Replayed records carry a stand-in Logger with the name of the
+	//! original, since the original may have been destroyed meanwhile,
+	//! and no backtrace frames.
+	//!
+	//! The sink may be shared by Loggers writing from several threads;
+	//! the primary and fallback sinks need not be thread-safe.
+	class FailoverSink : public Sink {
+	public:
+		//! Construct a new sink and start its watchdog thread
+		//!
+		//! \param primary Sink records normally go to.
+		//! \param fallback Sink records go to while failed over, or NULL.
+		inline explicit FailoverSink(Sink& primary, Sink* fallback = 0);
+
+		//! Stop the watchdog thread
+		//!
+		//! Waits for a write to the primary in progress, and discards
+		//! records still spilled.
+		inline ~FailoverSink();
+
+		//! Set when the primary is considered failed
+		//!
+		//! The defaults are 100 milliseconds and 3 errors.
+		//!
+		//! \param deadline Longest a write may take or wait to start.
+		//! \param errors Writes in a row returning false; at least 1.
+		void Deadline(::std::chrono::milliseconds deadline,
+				unsigned int errors) {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			_deadline = deadline;
+			_max_errors = errors != 0 ? errors : 1;
+		}
+
+		//! Set how failed over records are kept and retried
+		//!
+		//! The defaults are 4MB and 1 second.
+		//!
+		//! \param bytes Text of spilled records kept for replay.
+		//! \param retry Time between attempts to replay to the primary.
+		void Spill(::std::size_t bytes, ::std::chrono::milliseconds retry) {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			_max_spill = bytes;
+			_retry = retry;
+		}
+
+		//! Check if records are currently failed over
+		//!
+		//! \returns true if the primary is considered failed
+		bool Failed() const { return _failed.load(::std::memory_order_acquire); }
+
+		//! Get the number of times the primary has failed
+		//!
+		//! \returns Count of failovers.
+		unsigned long long Failovers() {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			return _failovers;
+		}
+
+		//! Get the number of spilled records discarded without replay
+		//!
+		//! \returns Count of discarded records.
+		unsigned long long Dropped() {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			return _dropped;
+		}
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		inline void Flush();
+
+	private:
+		FailoverSink(const FailoverSink&);
+		FailoverSink& operator=(const FailoverSink&);
+
+		//! A record kept for replay
+		struct Spilled {
+			LogLevel level;
+			//! Copy of the Logger name, which may be borrowed
+			::std::string name;
+			const char* file;
+			unsigned int line;
+			const char* func;
+			const char* format;
+			//! Formatted text followed by the message
+			::std::string data;
+			::std::size_t length;
+		};
+
+		typedef ::std::chrono::steady_clock Clock;
+
+		//! Mark the primary as failed and wake the watchdog; caller
+		//! holds the lock
+		inline void Fail();
+
+		//! Write a record to the fallback and the ring
+		//!
+		//! \returns false if the primary recovered meanwhile
+		inline bool SpillRecord(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		//! Replay spilled records to the primary
+		//!
+		//! \returns true if the primary has recovered
+		inline bool Replay();
+
+		//! Watchdog thread body
+		inline void Run();
+
+		Sink& _primary;
+
+		Sink* _fallback;
+
+		//! Guards the state below and the fallback
+		::std::mutex _lock;
+
+		//! Signalled when the primary stops being written
+		::std::condition_variable _idle;
+
+		//! Signalled when the primary fails and on destruction
+		::std::condition_variable _wake;
+
+		//! Set while a thread writes to the primary
+		bool _writing;
+
+		//! Writes to the primary in a row that returned false
+		unsigned int _errors;
+
+		::std::atomic<bool> _failed;
+
+		bool _running;
+
+		::std::chrono::milliseconds _deadline;
+
+		unsigned int _max_errors;
+
+		::std::size_t _max_spill;
+
+		::std::chrono::milliseconds _retry;
+
+		::std::deque<Spilled> _spilled;
+
+		//! Total text size of spilled records
+		::std::size_t _spill_bytes;
+
+		unsigned long long _failovers;
+
+		unsigned long long _dropped;
+
+		::std::thread _thread;
+	};
+
+	FailoverSink::FailoverSink(Sink& primary, Sink* fallback) :
+			_primary(primary), _fallback(fallback), _writing(false), _errors(0),
+			_failed(false),
+			_running(true), _deadline(100), _max_errors(3),
+			_max_spill(4 * 1024 * 1024), _retry(1000), _spill_bytes(0),
+			_failovers(0), _dropped(0) {
+		_thread = ::std::thread(&FailoverSink::Run, this);
+	}
+
+	FailoverSink::~FailoverSink() {
+		{
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			_running = false;
+		}
+		_wake.notify_all();
+		_thread.join();
+	}
+
+	bool FailoverSink::Write(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		for (;;) {
+			if (!_failed.load(::std::memory_order_acquire)) {
+				::std::unique_lock< ::std::mutex> guard(_lock);
+				const ::std::chrono::milliseconds deadline = _deadline;
+				if (!_idle.wait_for(guard, deadline, [this] { return !_writing; })) {
+					Fail();
+				} else if (!_failed.load(::std::memory_order_relaxed)) {
+					_writing = true;
+					guard.unlock();
+
+					const Clock::time_point start = Clock::now();
+					const bool written = _primary.Write(record, text, length);
+					const bool late = Clock::now() - start > deadline;
+
+					guard.lock();
+					_writing = false;
+					_errors = written ? 0 : _errors + 1;
+					const bool failed = late || _errors >= _max_errors;
+					if (failed) {
+						Fail();
+					}
+					guard.unlock();
+					_idle.notify_all();
+
+					if (written || !failed) {
+						return written;
+					}
+				}
+				// failed over while waiting; spill to keep the order
+			}
+
+			if (SpillRecord(record, text, length)) {
+				return true;
+			}
+		}
+	}
+
+	void FailoverSink::Flush() {
+		::std::unique_lock< ::std::mutex> guard(_lock);
+		if (_fallback != 0) {
+			_fallback->Flush();
+		}
+		if (_failed.load(::std::memory_order_relaxed)) {
+			return;
+		}
+
+		const ::std::chrono::milliseconds deadline = _deadline;
+		if (!_idle.wait_for(guard, deadline, [this] { return !_writing; })) {
+			Fail();
+			return;
+		}
+		_writing = true;
+		guard.unlock();
+
+		const Clock::time_point start = Clock::now();
+		_primary.Flush();
+		const bool late = Clock::now() - start > deadline;
+
+		guard.lock();
+		_writing = false;
+		if (late) {
+			Fail();
+		}
+		guard.unlock();
+		_idle.notify_all();
+	}
+
+	void FailoverSink::Fail() {
+		if (!_failed.load(::std::memory_order_relaxed)) {
+			_failed.store(true, ::std::memory_order_release);
+			++_failovers;
+			_wake.notify_all();
+		}
+	}
+
+	bool FailoverSink::SpillRecord(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		if (!_failed.load(::std::memory_order_relaxed)) {
+			return false;
+		}
+
+		if (_fallback != 0) {
+			_fallback->Write(record, text, length);
+		}
+
+		Spilled spilled;
+		spilled.level = record.level;
+		spilled.name.assign(record.logger->Name());
+		spilled.file = record.file;
+		spilled.line = record.line;
+		spilled.func = record.func;
+		spilled.format = record.format;
+		spilled.data.reserve(length + ::std::strlen(record.message));
+		spilled.data.append(text, length);
+		spilled.data.append(record.message);
+		spilled.length = length;
+		_spill_bytes += spilled.data.size();
+		_spilled.push_back(::std::move(spilled));
+
+		while (_spill_bytes > _max_spill) {
+			_spill_bytes -= _spilled.front().data.size();
+			_spilled.pop_front();
+			++_dropped;
+		}
+		return true;
+	}
+
+	bool FailoverSink::Replay() {
+		::std::unique_lock< ::std::mutex> guard(_lock);
+		const ::std::chrono::milliseconds deadline = _deadline;
+		if (!_idle.wait_for(guard, deadline, [this] { return !_writing; })) {
+			return false;
+		}
+		_writing = true;
+
+		bool recovered = false;
+		while (!recovered) {
+			if (_spilled.empty()) {
+				// writers waiting for the primary follow the last replayed
+				_failed.store(false, ::std::memory_order_release);
+				_errors = 0;
+				recovered = true;
+				break;
+			}
+			Spilled spilled = ::std::move(_spilled.front());
+			_spilled.pop_front();
+			_spill_bytes -= spilled.data.size();
+			guard.unlock();
+
+			const Logger standin(spilled.name.c_str());
+			const LogRecord record = { spilled.level, &standin, spilled.file,
+					spilled.line, spilled.func,
+					spilled.data.c_str() + spilled.length, 0, 0, spilled.format };
+			const Clock::time_point start = Clock::now();
+			const bool written = _primary.Write(record, spilled.data.data(),
+					spilled.length);
+			const bool late = Clock::now() - start > deadline;
+
+			guard.lock();
+			if (!written) {
+				_spill_bytes += spilled.data.size();
+				_spilled.push_front(::std::move(spilled));
+			}
+			if (!written || late) {
+				break;
+			}
+		}
+
+		_writing = false;
+		guard.unlock();
+		_idle.notify_all();
+		return recovered;
+	}
+
+	void FailoverSink::Run() {
+		::std::unique_lock< ::std::mutex> guard(_lock);
+		while (_running) {
+			if (!_failed.load(::std::memory_order_relaxed)) {
+				_wake.wait(guard);
+				continue;
+			}
+			_wake.wait_for(guard, _retry);
+			if (!_running) {
+				break;
+			}
+			guard.unlock();
+			Replay();
+			guard.lock();
+		}
+	}
+
+} // namespace easylogger
+
+#endif
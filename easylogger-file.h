@@ -0,0 +1,1086 @@
+//! \file easylogger-file.h
+//!
+//! File sinks for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_FILE_H)
+#define EASYLOGGER_FILE_H
+
+#include "easylogger.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+namespace easylogger {
+
+	//! Sink appending records to a file, with a disk space guard
+	//!
+	//! Each record is written with a single write() call to a file
+	//! opened with O_APPEND, so records are never split and are
+	//! visible to readers as soon as Write() returns.
+	//!
+	//! The disk space guard samples the free space of the file system
+	//! with statvfs() every few records or bytes.  Once free space
+	//! drops below the low threshold, the sink progressively discards
+	//! lower-level records: first TRACE, then DEBUG, INFO, WARNING and
+	//! ERROR as free space approaches the critical threshold.  Below
+	//! the critical threshold only FATAL records are written.  A write
+	//! failing with ENOSPC puts the sink straight into the critical
+	//! state until the next sample shows space has been freed.
+	//! Discarded records are counted, never retried, and never block.
+	//!
+	//! By default written data stays in the page cache like any other
+	//! file data, where a busy log can evict the cached files of the
+	//! application itself.  Cache() selects a mode that keeps log data
+	//! out of the cache instead.
+	class FileSink : public Sink {
+	public:
+		//! How written data is kept out of the page cache
+		enum CacheMode {
+			CACHE_KEEP,		//!< Leave written data to the kernel (default)
+			CACHE_DROP,		//!< Write back and drop data behind the write head
+			CACHE_DIRECT	//!< Write whole blocks with O_DIRECT
+		};
+
+		//! Alignment of O_DIRECT writes, in bytes
+		enum { DIRECT_ALIGN = 4096 };
+
+		//! Open a file for appending
+		//!
+		//! \param path Path of file; it is created if it does not exist.
+		inline explicit FileSink(const ::std::string& path);
+
+		inline ~FileSink();
+
+		//! Check if the file was opened successfully
+		//!
+		//! \returns true if file is open
+		bool IsOpen() const { return _fd >= 0; }
+
+		//! Configure the disk space guard
+		//!
+		//! Both thresholds are in bytes of space available to
+		//! unprivileged users.  Passing 0 for both disables the guard,
+		//! which is the default.
+		//!
+		//! \param low Free space below which records start being dropped.
+		//! \param critical Free space below which only FATAL is written.
+		inline void DiskGuard(unsigned long long low,
+				unsigned long long critical);
+
+		//! Configure how often free space is sampled
+		//!
+		//! Free space is sampled after whichever of the two limits is
+		//! reached first.  Dropped records count towards the record
+		//! limit so that a degraded sink notices when space returns.
+		//!
+		//! \param records Records between samples.
+		//! \param bytes Bytes written between samples.
+		void SampleEvery(unsigned long records, unsigned long long bytes) {
+			_sample_records = records;
+			_sample_bytes = bytes;
+		}
+
+		//! Get the minimum level currently being written
+		//!
+		//! \returns LEVEL_TRACE when healthy, up to LEVEL_FATAL when
+		//! the disk is critically full.
+		LogLevel MinLevel() const { return _min_level; }
+
+		//! Get the number of records dropped by the guard or by errors
+		//!
+		//! \returns Count of dropped records.
+		unsigned long long Dropped() const { return _dropped; }
+
+		//! Keep written data out of the page cache
+		//!
+		//! With CACHE_DROP, records are still written as they arrive.
+		//! Each time another chunk of the file has been written, its
+		//! writeback is started with sync_file_range(), and the chunk
+		//! before it is waited for and dropped from the cache with
+		//! posix_fadvise(), so at most two chunks of the log are cached
+		//! at any time.
+		//!
+		//! With CACHE_DIRECT, records are gathered in an aligned buffer
+		//! of one chunk, which is written with O_DIRECT when it fills.
+		//! Records are only visible to readers once written, so call
+		//! Flush() regularly; it writes the whole blocks of the buffer
+		//! directly and the partial block at its end through the page
+		//! cache, to be rewritten directly once the block fills.
+		//!
+		//! \param mode Mode to use.
+		//! \param chunk Bytes per chunk, rounded up to DIRECT_ALIGN.
+		//! \returns false if the mode is not supported by the system or
+		//! file system; the sink then keeps its previous mode.
+		inline bool Cache(CacheMode mode, ::std::size_t chunk = 1 << 20);
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		//! Write the records of a batch with a single write
+		inline bool WriteBatch(const LogRecord* records, const char* text,
+				const ::std::size_t* lengths, ::std::size_t count);
+
+		inline void Flush();
+
+	private:
+		FileSink(const FileSink&);
+		FileSink& operator=(const FileSink&);
+
+		//! Sample free space and recompute the minimum level
+		inline void Sample();
+
+		//! Count records and check if a level may be written
+		inline bool Admit(LogLevel level, unsigned long records);
+
+		//! Write text in the current cache mode
+		inline bool Store(const char* text, ::std::size_t length);
+
+		//! Write bytes at the end of the file through the page cache
+		inline bool Append(const char* text, ::std::size_t length);
+
+		//! Start writeback of completed chunks and drop older ones
+		inline void DropBehind();
+
+		//! Gather bytes into the direct buffer
+		inline bool Gather(const char* text, ::std::size_t length);
+
+		//! Write the first bytes of the direct buffer with O_DIRECT
+		inline bool WriteDirect(::std::size_t bytes);
+
+		//! Find the end of the file and restart the direct buffer there
+		inline void Reposition();
+
+		//! Write out the direct buffer and release it
+		inline void CloseDirect();
+
+		::std::string _path;
+
+		int _fd;
+
+		unsigned long long _low;
+
+		unsigned long long _critical;
+
+		unsigned long _sample_records;
+
+		unsigned long long _sample_bytes;
+
+		unsigned long _records_since;
+
+		unsigned long long _bytes_since;
+
+		LogLevel _min_level;
+
+		unsigned long long _dropped;
+
+		CacheMode _mode;
+
+		::std::size_t _chunk;
+
+		//! Logical end of the file, including buffered bytes
+		unsigned long long _offset;
+
+		//! Start of the first chunk whose writeback is not started
+		unsigned long long _synced;
+
+		int _direct;
+
+		char* _buffer;
+
+		//! Aligned file offset of the start of the direct buffer
+		unsigned long long _buffer_start;
+
+		::std::size_t _used;
+
+		//! Bytes of the direct buffer already written through the cache
+		::std::size_t _flushed;
+	};
+
+	FileSink::FileSink(const ::std::string& path) : _path(path), _fd(-1),
+			_low(0), _critical(0), _sample_records(256),
+			_sample_bytes(256 * 1024), _records_since(0), _bytes_since(0),
+			_min_level(LEVEL_TRACE), _dropped(0), _mode(CACHE_KEEP), _chunk(0),
+			_offset(0), _synced(0), _direct(-1), _buffer(0), _buffer_start(0),
+			_used(0), _flushed(0) {
+		_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+				0644);
+	}
+
+	FileSink::~FileSink() {
+		CloseDirect();
+		if (_fd >= 0) {
+			::close(_fd);
+		}
+	}
+
+	bool FileSink::Cache(CacheMode mode, ::std::size_t chunk) {
+		chunk = (chunk + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+		if (chunk == 0) {
+			chunk = DIRECT_ALIGN;
+		}
+		if (_fd < 0) {
+			return false;
+		}
+
+#if defined(__linux__)
+		int direct = -1;
+		void* buffer = 0;
+		if (mode == CACHE_DIRECT) {
+			direct = ::open(_path.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+			if (direct < 0) {
+				return false;
+			}
+			if (::posix_memalign(&buffer, DIRECT_ALIGN, chunk) != 0) {
+				::close(direct);
+				return false;
+			}
+		}
+
+		CloseDirect();
+		_mode = mode;
+		_chunk = chunk;
+		_direct = direct;
+		_buffer = static_cast<char*>(buffer);
+		Reposition();
+		_synced = _offset;
+		return true;
+#else
+		if (mode != CACHE_KEEP) {
+			return false;
+		}
+		CloseDirect();
+		_mode = mode;
+		_chunk = chunk;
+		return true;
+#endif
+	}
+
+	void FileSink::Reposition() {
+		struct stat st;
+		_offset = ::fstat(_fd, &st) == 0 ?
+				static_cast<unsigned long long>(st.st_size) : 0;
+		// bytes up to the first aligned offset go through the page cache
+		_buffer_start = (_offset + DIRECT_ALIGN - 1) / DIRECT_ALIGN *
+				DIRECT_ALIGN;
+		_used = 0;
+		_flushed = 0;
+	}
+
+	void FileSink::CloseDirect() {
+		if (_direct < 0) {
+			return;
+		}
+		const ::std::size_t whole = _used / DIRECT_ALIGN * DIRECT_ALIGN;
+		if (whole != 0) {
+			WriteDirect(whole);
+		}
+		if (_used > _flushed) {
+			Append(_buffer + _flushed, _used - _flushed);
+		}
+		::close(_direct);
+		::free(_buffer);
+		_direct = -1;
+		_buffer = 0;
+		_used = 0;
+		_flushed = 0;
+	}
+
+	void FileSink::DiskGuard(unsigned long long low,
+			unsigned long long critical) {
+		_low = low > critical ? low : critical;
+		_critical = critical;
+		Sample();
+	}
+
+	void FileSink::Sample() {
+		_records_since = 0;
+		_bytes_since = 0;
+
+		struct statvfs st;
+		if ((_low == 0 && _critical == 0) || _fd < 0 ||
+				::fstatvfs(_fd, &st) != 0) {
+			_min_level = LEVEL_TRACE;
+			return;
+		}
+
+		const unsigned long long avail =
+				static_cast<unsigned long long>(st.f_bavail) * st.f_frsize;
+		if (avail <= _critical) {
+			_min_level = LEVEL_FATAL;
+		} else if (avail >= _low) {
+			_min_level = LEVEL_TRACE;
+		} else {
+			// spread DEBUG through ERROR evenly between the thresholds
+			const unsigned long long steps = LEVEL_ERROR - LEVEL_DEBUG + 1;
+			const unsigned long long step = (_low - avail) * steps /
+					(_low - _critical);
+			_min_level = static_cast<LogLevel>(LEVEL_DEBUG +
+					(step < steps ? step : steps - 1));
+		}
+	}
+
+	bool FileSink::Write(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		return Admit(record.level, 1) && Store(text, length);
+	}
+
+	bool FileSink::WriteBatch(const LogRecord* records, const char* text,
+			const ::std::size_t* lengths, ::std::size_t count) {
+		// the records of a batch share a level, so they are dropped or
+		// written together
+		::std::size_t length = 0;
+		for (::std::size_t i = 0; i != count; ++i) {
+			length += lengths[i];
+		}
+		return Admit(records[0].level, count) && Store(text, length);
+	}
+
+	bool FileSink::Admit(LogLevel level, unsigned long records) {
+		if ((_records_since += records) >= _sample_records ||
+				_bytes_since >= _sample_bytes) {
+			Sample();
+		}
+
+		if (_fd < 0 || level < _min_level) {
+			_dropped += records;
+			return false;
+		}
+		return true;
+	}
+
+	bool FileSink::Store(const char* text, ::std::size_t length) {
+		if (_mode == CACHE_DIRECT) {
+			return Gather(text, length);
+		}
+		if (!Append(text, length)) {
+			return false;
+		}
+		_offset += length;
+		if (_mode == CACHE_DROP) {
+			DropBehind();
+		}
+		return true;
+	}
+
+	bool FileSink::Append(const char* text, ::std::size_t length) {
+		while (length != 0) {
+			const ssize_t rs = ::write(_fd, text, length);
+			if (rs < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno == ENOSPC && (_low != 0 || _critical != 0)) {
+					_min_level = LEVEL_FATAL;
+				}
+				++_dropped;
+				return false;
+			}
+			text += rs;
+			length -= rs;
+			_bytes_since += rs;
+		}
+		return true;
+	}
+
+	void FileSink::DropBehind() {
+#if defined(__linux__)
+		while (_offset - _synced >= _chunk) {
+			::sync_file_range(_fd, _synced, _chunk, SYNC_FILE_RANGE_WRITE);
+			// the previous chunk has had a whole chunk's time to be written
+			if (_synced >= _chunk) {
+				const unsigned long long behind = _synced - _chunk;
+				::sync_file_range(_fd, behind, _chunk,
+						SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+						SYNC_FILE_RANGE_WAIT_AFTER);
+				::posix_fadvise(_fd, behind, _chunk, POSIX_FADV_DONTNEED);
+			}
+			_synced += _chunk;
+		}
+#endif
+	}
+
+	bool FileSink::Gather(const char* text, ::std::size_t length) {
+		if (_offset < _buffer_start) {
+			const ::std::size_t head = _buffer_start - _offset < length ?
+					static_cast< ::std::size_t>(_buffer_start - _offset) : length;
+			if (!Append(text, head)) {
+				return false;
+			}
+			_offset += head;
+			text += head;
+			length -= head;
+		}
+
+		while (length != 0) {
+			const ::std::size_t part = _chunk - _used < length ?
+					_chunk - _used : length;
+			::std::memcpy(_buffer + _used, text, part);
+			_used += part;
+			_offset += part;
+			_bytes_since += part;
+			text += part;
+			length -= part;
+			if (_used == _chunk && !WriteDirect(_chunk)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool FileSink::WriteDirect(::std::size_t bytes) {
+		::std::size_t done = 0;
+		while (done != bytes) {
+			const ssize_t rs = ::pwrite(_direct, _buffer + done, bytes - done,
+					_buffer_start + done);
+			if (rs < 0 && errno == EINTR) {
+				continue;
+			}
+			if (rs <= 0 || rs % DIRECT_ALIGN != 0) {
+				if (rs < 0 && errno == ENOSPC && (_low != 0 || _critical != 0)) {
+					_min_level = LEVEL_FATAL;
+				}
+				// the buffered records are lost; start again at the end
+				++_dropped;
+				Reposition();
+				return false;
+			}
+			done += rs;
+		}
+
+		::std::memmove(_buffer, _buffer + bytes, _used - bytes);
+		_used -= bytes;
+		_flushed = _flushed > bytes ? _flushed - bytes : 0;
+		_buffer_start += bytes;
+		return true;
+	}
+
+	void FileSink::Flush() {
+		if (_fd < 0) {
+			return;
+		}
+		if (_mode == CACHE_DIRECT) {
+			const ::std::size_t whole = _used / DIRECT_ALIGN * DIRECT_ALIGN;
+			if (whole != 0 && !WriteDirect(whole)) {
+				return;
+			}
+			if (_used > _flushed && Append(_buffer + _flushed, _used - _flushed)) {
+				_flushed = _used;
+			}
+		}
+		::fdatasync(_fd);
+		if (_mode != CACHE_KEEP) {
+			::posix_fadvise(_fd, 0, 0, POSIX_FADV_DONTNEED);
+		}
+	}
+
+	//! Sink routing each record to a file chosen by a key
+	//!
+	//! The path of a record's file is built from a template, in which
+	//! %N is replaced by the name of the Logger the record was logged
+	//! to, %L by its level, %K by the key the key function returns for
+	//! the record, and %% by a single %.  In replaced values, slashes
+	//! and leading dots become '_', so that a key cannot name a file
+	//! outside the template's directories.  Directories are not
+	//! created.
+	//!
+	//! Only a limited number of files are kept open; when a new file
+	//! is needed, the least recently written one is closed.  Records
+	//! for each open file are gathered in a write buffer, which is
+	//! written out with a single write() when it fills, when the file
+	//! is closed, and on Flush().  Buffers are only allocated while a
+	//! file has pending records, and their total size is bounded: at
+	//! the bound, the least recently written file's buffer is written
+	//! out and released.  Records larger than a buffer are written
+	//! directly.
+	//!
+	//! Unlike FileSink, the sink may be shared by Loggers writing
+	//! from several threads.
+	class KeyedFileSink : public Sink {
+	public:
+		//! Function computing the key of a record
+		//!
+		//! \param record Record being routed.
+		//! \param key String to append the key to; empty on entry.
+		typedef void (*KeyFunction)(const LogRecord& record,
+				::std::string& key);
+
+		//! Construct a new sink
+		//!
+		//! \param path Path template.
+		//! \param key Function computing %K, or NULL.
+		inline explicit KeyedFileSink(const ::std::string& path,
+				KeyFunction key = 0);
+
+		inline ~KeyedFileSink();
+
+		//! Set the open file and buffer limits
+		//!
+		//! Writes out and releases all buffers.  The defaults are 256
+		//! files, 16KB per buffer and 4MB in total.
+		//!
+		//! \param files Maximum number of open files; at least 1.
+		//! \param buffer Size of each write buffer; 0 disables buffering.
+		//! \param memory Maximum total size of all write buffers.
+		inline void Limits(::std::size_t files, ::std::size_t buffer,
+				::std::size_t memory);
+
+		//! Get the number of open files
+		//!
+		//! \returns Count of open files.
+		::std::size_t OpenFiles() {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			return _files.size();
+		}
+
+		//! Get the number of records that could not be written
+		//!
+		//! \returns Count of dropped records.
+		unsigned long long Dropped() {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			return _dropped;
+		}
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		inline void Flush();
+
+	private:
+		KeyedFileSink(const KeyedFileSink&);
+		KeyedFileSink& operator=(const KeyedFileSink&);
+
+		//! An open file, linked in least recently used order
+		struct File {
+			::std::string path;
+			int fd;
+			char* buffer;
+			::std::size_t used;
+			File* newer;
+			File* older;
+		};
+
+		//! Build the path of a record's file into _path
+		inline void BuildPath(const LogRecord& record);
+
+		//! Append a value to _path, replacing unsafe characters
+		inline void AppendSafe(const char* value, ::std::size_t length);
+
+		//! Find or open the file named by _path, making it the newest
+		inline File* Acquire();
+
+		//! Remove a file from the recently used list
+		inline void Unlink(File* file);
+
+		//! Write out and free the buffer of a file
+		inline void Release(File* file);
+
+		//! Write out the buffer of a file, keeping it
+		inline void WriteOut(File* file);
+
+		//! Write out a file's buffer and close it
+		inline void Close(File* file);
+
+		//! Write all of a text to a descriptor
+		static inline bool WriteAll(int fd, const char* text,
+				::std::size_t length);
+
+		::std::mutex _lock;
+
+		::std::string _template;
+
+		KeyFunction _key;
+
+		::std::size_t _max_files;
+
+		::std::size_t _buffer_size;
+
+		::std::size_t _max_memory;
+
+		//! Total size of allocated buffers
+		::std::size_t _memory;
+
+		::std::unordered_map< ::std::string, File*> _files;
+
+		File* _newest;
+
+		File* _oldest;
+
+		//! Scratch strings, kept to reuse their storage
+		::std::string _path;
+
+		::std::string _value;
+
+		unsigned long long _dropped;
+	};
+
+	KeyedFileSink::KeyedFileSink(const ::std::string& path, KeyFunction key) :
+			_template(path), _key(key), _max_files(256),
+			_buffer_size(16 * 1024), _max_memory(4 * 1024 * 1024), _memory(0),
+			_newest(0), _oldest(0), _dropped(0) {}
+
+	KeyedFileSink::~KeyedFileSink() {
+		while (_oldest != 0) {
+			Close(_oldest);
+		}
+	}
+
+	void KeyedFileSink::Limits(::std::size_t files, ::std::size_t buffer,
+			::std::size_t memory) {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		for (File* file = _newest; file != 0; file = file->older) {
+			Release(file);
+		}
+		_max_files = files != 0 ? files : 1;
+		_buffer_size = buffer;
+		_max_memory = memory;
+		while (_files.size() > _max_files) {
+			Close(_oldest);
+		}
+	}
+
+	void KeyedFileSink::AppendSafe(const char* value, ::std::size_t length) {
+		bool leading = true;
+		for (::std::size_t i = 0; i != length; ++i) {
+			leading = leading && value[i] == '.';
+			_path += value[i] == '/' || leading ? '_' : value[i];
+		}
+	}
+
+	void KeyedFileSink::BuildPath(const LogRecord& record) {
+		static const char* const LEVELS[] = { "TRACE", "DEBUG", "INFO",
+				"WARNING", "ERROR", "FATAL" };
+
+		_path.clear();
+		for (const char* cptr = _template.c_str(); *cptr != 0; ++cptr) {
+			if (*cptr != '%' || cptr[1] == 0) {
+				_path += *cptr;
+				continue;
+			}
+			switch (*++cptr) {
+			case 'N':
+				AppendSafe(record.logger->Name(),
+						::std::strlen(record.logger->Name()));
+				break;
+			case 'L':
+				_path += record.level <= LEVEL_FATAL ? LEVELS[record.level] :
+						"UNKNOWN";
+				break;
+			case 'K':
+				_value.clear();
+				if (_key != 0) {
+					_key(record, _value);
+				}
+				AppendSafe(_value.data(), _value.size());
+				break;
+			default:
+				_path += *cptr;
+				break;
+			}
+		}
+	}
+
+	KeyedFileSink::File* KeyedFileSink::Acquire() {
+		::std::unordered_map< ::std::string, File*>::iterator found =
+				_files.find(_path);
+		File* file;
+		if (found != _files.end()) {
+			file = found->second;
+			if (file == _newest) {
+				return file;
+			}
+			Unlink(file);
+		} else {
+			if (_files.size() >= _max_files) {
+				Close(_oldest);
+			}
+			const int fd = ::open(_path.c_str(),
+					O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+			if (fd < 0) {
+				return 0;
+			}
+			file = new File;
+			file->path = _path;
+			file->fd = fd;
+			file->buffer = 0;
+			file->used = 0;
+			_files[_path] = file;
+		}
+
+		file->older = _newest;
+		file->newer = 0;
+		if (_newest != 0) {
+			_newest->newer = file;
+		} else {
+			_oldest = file;
+		}
+		_newest = file;
+		return file;
+	}
+
+	void KeyedFileSink::Unlink(File* file) {
+		(file->newer != 0 ? file->newer->older : _newest) = file->older;
+		(file->older != 0 ? file->older->newer : _oldest) = file->newer;
+	}
+
+	bool KeyedFileSink::WriteAll(int fd, const char* text,
+			::std::size_t length) {
+		while (length != 0) {
+			const ssize_t rs = ::write(fd, text, length);
+			if (rs < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			text += rs;
+			length -= rs;
+		}
+		return true;
+	}
+
+	void KeyedFileSink::WriteOut(File* file) {
+		if (file->used != 0 && !WriteAll(file->fd, file->buffer, file->used)) {
+			++_dropped;
+		}
+		file->used = 0;
+	}
+
+	void KeyedFileSink::Release(File* file) {
+		if (file->buffer != 0) {
+			WriteOut(file);
+			delete[] file->buffer;
+			file->buffer = 0;
+			_memory -= _buffer_size;
+		}
+	}
+
+	void KeyedFileSink::Close(File* file) {
+		Release(file);
+		::close(file->fd);
+		Unlink(file);
+		_files.erase(file->path);
+		delete file;
+	}
+
+	bool KeyedFileSink::Write(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		BuildPath(record);
+		File* file = Acquire();
+		if (file == 0) {
+			++_dropped;
+			return false;
+		}
+
+		if (file->buffer == 0 && length < _buffer_size) {
+			// make room by releasing the buffers of the oldest files
+			for (File* victim = _oldest; victim != file &&
+					_memory + _buffer_size > _max_memory;
+					victim = victim->newer) {
+				Release(victim);
+			}
+			if (_memory + _buffer_size <= _max_memory) {
+				file->buffer = new char[_buffer_size];
+				_memory += _buffer_size;
+			}
+		}
+
+		if (file->buffer != 0 && file->used + length > _buffer_size) {
+			WriteOut(file);
+		}
+		if (file->buffer == 0 || length > _buffer_size) {
+			if (!WriteAll(file->fd, text, length)) {
+				++_dropped;
+				return false;
+			}
+			return true;
+		}
+		::std::memcpy(file->buffer + file->used, text, length);
+		file->used += length;
+		return true;
+	}
+
+	void KeyedFileSink::Flush() {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		for (File* file = _newest; file != 0; file = file->older) {
+			if (file->buffer != 0) {
+				WriteOut(file);
+			}
+			::fdatasync(file->fd);
+		}
+	}
+
+	//! Sink appending records to a file through a shared double buffer
+	//!
+	//! Records are gathered in a buffer shared by all threads, without
+	//! a lock and without a background thread.  A thread reserves
+	//! space for its record with a single atomic fetch_add on a byte
+	//! position, copies the record into place, and counts it as
+	//! committed.  The buffer is split in two halves: a record that
+	//! does not fit in the rest of the current half closes that half
+	//! and is placed in the next one, which takes over while the first
+	//! is written out.  Whichever thread commits the last record of a
+	//! half writes the half to the file with a single write(), so
+	//! lines from different threads are never interleaved.
+	//!
+	//! A thread only waits when it reaches a half whose previous
+	//! contents are still being written, or when it must write out a
+	//! half before the one before it has been written.  Records longer
+	//! than half of a half are written directly, and may land ahead
+	//! of records still in the buffer.
+	//!
+	//! Records only reach the file once their half is full or on
+	//! Flush().
+	class SharedBufferSink : public Sink {
+	public:
+		//! Open a file for appending
+		//!
+		//! \param path Path of file; it is created if it does not exist.
+		//! \param size Size of each half of the buffer, in bytes.
+		inline explicit SharedBufferSink(const ::std::string& path,
+				::std::size_t size = 64 * 1024);
+
+		//! Write out buffered records and close the file
+		inline ~SharedBufferSink();
+
+		//! Check if the file was opened successfully
+		//!
+		//! \returns true if file is open
+		bool IsOpen() const { return _fd >= 0; }
+
+		//! Get the number of records that could not be written
+		//!
+		//! \returns Count of dropped records.
+		unsigned long long Dropped() const {
+			return _dropped.load(::std::memory_order_relaxed);
+		}
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		//! Write out the records buffered so far and sync the file
+		inline void Flush();
+
+	private:
+		SharedBufferSink(const SharedBufferSink&);
+		SharedBufferSink& operator=(const SharedBufferSink&);
+
+		//! One half of the buffer
+		//!
+		//! Half number g covers byte positions g * size up to
+		//! (g + 1) * size, and is held in _halves[g % 2].  Every byte
+		//! of that range is counted in done exactly once: as part of a
+		//! record, as the unused end before a record that did not fit,
+		//! or as the start taken by that record in the next half.
+		struct Half {
+			//! Number of the half this buffer is ready to hold
+			::std::atomic<unsigned long long> number;
+			//! Bytes of the half accounted for
+			::std::atomic< ::std::size_t> done;
+			//! Records committed to the half
+			::std::atomic<unsigned long> records;
+			//! Offset of the first and past the last byte to write
+			::std::size_t begin;
+			::std::size_t end;
+			char* data;
+		};
+
+		//! Wait until a half's buffer is free, and get it
+		inline Half& Acquire(unsigned long long number);
+
+		//! Account for bytes of a half, writing it out once complete
+		inline void Commit(unsigned long long number, ::std::size_t bytes,
+				unsigned long records);
+
+		//! Write out a complete half once the halves before it are
+		inline void WriteOut(unsigned long long number);
+
+		//! Write all of a text to the file
+		inline bool WriteAll(const char* text, ::std::size_t length);
+
+		int _fd;
+
+		::std::size_t _size;
+
+		Half _halves[2];
+
+		//! Next byte position to reserve
+		::std::atomic<unsigned long long> _tail;
+
+		//! Number of the next half to write out
+		::std::atomic<unsigned long long> _written;
+
+		::std::atomic<unsigned long long> _dropped;
+	};
+
+	SharedBufferSink::SharedBufferSink(const ::std::string& path,
+			::std::size_t size) : _fd(-1), _size(size != 0 ? size : 1),
+			_tail(0), _written(0), _dropped(0) {
+		for (unsigned int i = 0; i != 2; ++i) {
+			_halves[i].number.store(i, ::std::memory_order_relaxed);
+			_halves[i].done.store(0, ::std::memory_order_relaxed);
+			_halves[i].records.store(0, ::std::memory_order_relaxed);
+			_halves[i].begin = 0;
+			_halves[i].end = _size;
+			_halves[i].data = new char[_size];
+		}
+		_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+				0644);
+	}
+
+	SharedBufferSink::~SharedBufferSink() {
+		Flush();
+		if (_fd >= 0) {
+			::close(_fd);
+		}
+		delete[] _halves[0].data;
+		delete[] _halves[1].data;
+	}
+
+	bool SharedBufferSink::Write(const LogRecord&, const char* text,
+			::std::size_t length) {
+		if (_fd < 0) {
+			_dropped.fetch_add(1, ::std::memory_order_relaxed);
+			return false;
+		}
+		if (length == 0) {
+			return true;
+		}
+		// a record that does not fit in the rest of a half is tried again
+		// in the next; one longer than half a half might never fit
+		if (length > _size / 2) {
+			if (!WriteAll(text, length)) {
+				_dropped.fetch_add(1, ::std::memory_order_relaxed);
+				return false;
+			}
+			return true;
+		}
+
+		for (;;) {
+			const unsigned long long pos = _tail.fetch_add(length,
+					::std::memory_order_relaxed);
+			const unsigned long long number = pos / _size;
+			const unsigned long long boundary = (number + 1) * _size;
+			Half& half = Acquire(number);
+			const ::std::size_t offset = static_cast< ::std::size_t>(
+					pos - number * _size);
+
+			if (pos + length <= boundary) {
+				::std::memcpy(half.data + offset, text, length);
+				Commit(number, length, 1);
+				return true;
+			}
+
+			// close this half before the record, and skip the part of
+			// the record's space that fell into the next half
+			half.end = offset;
+			Commit(number, static_cast< ::std::size_t>(boundary - pos), 0);
+			Half& next = Acquire(number + 1);
+			next.begin = static_cast< ::std::size_t>(pos + length - boundary);
+			Commit(number + 1, next.begin, 0);
+		}
+	}
+
+	void SharedBufferSink::Flush() {
+		unsigned long long pos = _tail.load(::std::memory_order_relaxed);
+		unsigned long long target;
+		for (;;) {
+			const unsigned long long number = pos / _size;
+			const ::std::size_t offset = static_cast< ::std::size_t>(
+					pos - number * _size);
+			if (offset == 0) {
+				target = number;
+				break;
+			}
+			// reserve the rest of the half, closing it
+			const unsigned long long boundary = (number + 1) * _size;
+			if (_tail.compare_exchange_weak(pos, boundary,
+					::std::memory_order_relaxed)) {
+				Half& half = Acquire(number);
+				half.end = offset;
+				Commit(number, static_cast< ::std::size_t>(boundary - pos), 0);
+				target = number + 1;
+				break;
+			}
+		}
+
+		while (_written.load(::std::memory_order_acquire) < target) {
+			::std::this_thread::yield();
+		}
+		if (_fd >= 0) {
+			::fdatasync(_fd);
+		}
+	}
+
+	SharedBufferSink::Half& SharedBufferSink::Acquire(
+			unsigned long long number) {
+		Half& half = _halves[number % 2];
+		while (half.number.load(::std::memory_order_acquire) != number) {
+			::std::this_thread::yield();
+		}
+		return half;
+	}
+
+	void SharedBufferSink::Commit(unsigned long long number,
+			::std::size_t bytes, unsigned long records) {
+		Half& half = _halves[number % 2];
+		if (records != 0) {
+			half.records.fetch_add(records, ::std::memory_order_relaxed);
+		}
+		if (half.done.fetch_add(bytes, ::std::memory_order_acq_rel) + bytes ==
+				_size) {
+			WriteOut(number);
+		}
+	}
+
+	void SharedBufferSink::WriteOut(unsigned long long number) {
+		while (_written.load(::std::memory_order_acquire) != number) {
+			::std::this_thread::yield();
+		}
+
+		Half& half = _halves[number % 2];
+		if (half.end > half.begin &&
+				!WriteAll(half.data + half.begin, half.end - half.begin)) {
+			_dropped.fetch_add(half.records.load(::std::memory_order_relaxed),
+					::std::memory_order_relaxed);
+		}
+
+		half.done.store(0, ::std::memory_order_relaxed);
+		half.records.store(0, ::std::memory_order_relaxed);
+		half.begin = 0;
+		half.end = _size;
+		half.number.store(number + 2, ::std::memory_order_release);
+		_written.store(number + 1, ::std::memory_order_release);
+	}
+
+	bool SharedBufferSink::WriteAll(const char* text, ::std::size_t length) {
+		while (length != 0) {
+			const ssize_t rs = ::write(_fd, text, length);
+			if (rs < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			text += rs;
+			length -= rs;
+		}
+		return true;
+	}
+
+} // namespace easylogger
+
+#endif
@@ -0,0 +1,379 @@
+//! \file easylogger-functrace.cc
+//!
+//! Compiler-instrumented function tracing for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! This file must be compiled without -finstrument-functions.
+
+#if !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
+#include "easylogger-functrace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+#endif
+
+#define EASY_NO_INSTRUMENT __attribute__((no_instrument_function))
+
+namespace easylogger {
+namespace functrace {
+
+	namespace _private {
+
+		//! One recorded function entry or exit
+		//!
+		//! \internal
+		struct Event {
+			//! Address of the function
+			void* fn;
+
+			//! Cycle counter, with EXIT_BIT set for an exit
+			unsigned long long stamp;
+		};
+
+		//! Events recorded by one thread
+		//!
+		//! Only the owning thread writes events and head; Clear()
+		//! moves cleared instead of resetting head, so it never races
+		//! with the owner.
+		//!
+		//! \internal
+		struct Ring {
+			Event* events;
+
+			//! Capacity minus one; the capacity is a power of two
+			::std::size_t mask;
+
+			//! Count of events recorded so far
+			::std::atomic<unsigned long long> head;
+
+			//! Value of head at the last Clear()
+			::std::atomic<unsigned long long> cleared;
+
+			long tid;
+
+			//! Set once the owner can no longer record into the ring
+			::std::atomic<bool> exited;
+
+			Ring* next;
+		};
+
+		//! Process-wide state of function tracing
+		//!
+		//! \internal
+		class Tracer {
+		public:
+			//! Top bit of an event stamp marks a function exit
+			static const unsigned long long EXIT_BIT = 1ULL << 63;
+
+			EASY_NO_INSTRUMENT static void Capacity(::std::size_t events);
+
+			EASY_NO_INSTRUMENT static void Start();
+
+			EASY_NO_INSTRUMENT static void Stop();
+
+			EASY_NO_INSTRUMENT static void Dump(::std::ostream& os,
+					bool symbolize);
+
+			EASY_NO_INSTRUMENT static void Clear();
+
+			//! Record an event into the calling thread's ring
+			//!
+			//! \param fn Address of the function.
+			//! \param flags EXIT_BIT for an exit, 0 for an entry.
+			EASY_NO_INSTRUMENT static inline void Record(void* fn,
+					unsigned long long flags);
+
+		private:
+			//! Marks the thread's ring as exited when the thread ends
+			struct RingOwner {
+				Ring* ring;
+
+				EASY_NO_INSTRUMENT ~RingOwner();
+			};
+
+			EASY_NO_INSTRUMENT static inline unsigned long long Cycles();
+
+			EASY_NO_INSTRUMENT static Ring* NewRing();
+
+			EASY_NO_INSTRUMENT static void WriteName(::std::ostream& os,
+					void* fn, bool symbolize);
+
+			static ::std::atomic<bool> _enabled;
+
+			static ::std::atomic< ::std::size_t> _capacity;
+
+			//! Lock held while walking or modifying the rings
+			static ::std::mutex _lock;
+
+			static Ring* _rings;
+
+			static unsigned long long _start_cycles;
+
+			static ::std::chrono::steady_clock::time_point _start_time;
+
+			//! Stands in for the ring of a thread that is exiting, so
+			//! functions called by later thread_local destructors are
+			//! not recorded into a ring Clear() may have released
+			static Ring _retired;
+
+			static thread_local Ring* _ring;
+
+			static thread_local RingOwner _owner;
+		};
+
+		::std::atomic<bool> Tracer::_enabled(false);
+
+		::std::atomic< ::std::size_t> Tracer::_capacity(1 << 15);
+
+		::std::mutex Tracer::_lock;
+
+		Ring* Tracer::_rings = 0;
+
+		unsigned long long Tracer::_start_cycles = 0;
+
+		::std::chrono::steady_clock::time_point Tracer::_start_time;
+
+		Ring Tracer::_retired;
+
+		thread_local Ring* Tracer::_ring = 0;
+
+		thread_local Tracer::RingOwner Tracer::_owner = { 0 };
+
+		Tracer::RingOwner::~RingOwner() {
+			_ring = &_retired;
+			if (ring != 0) {
+				ring->exited.store(true, ::std::memory_order_release);
+			}
+		}
+
+		unsigned long long Tracer::Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+#else
+			return ::std::chrono::duration_cast< ::std::chrono::nanoseconds>(
+					::std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+		Ring* Tracer::NewRing() {
+			::std::size_t capacity = 1;
+			while (capacity < _capacity.load(::std::memory_order_relaxed)) {
+				capacity <<= 1;
+			}
+
+			Ring* ring = new Ring;
+			ring->events = new Event[capacity];
+			ring->mask = capacity - 1;
+			ring->head.store(0, ::std::memory_order_relaxed);
+			ring->cleared.store(0, ::std::memory_order_relaxed);
+			ring->tid = ::syscall(SYS_gettid);
+			ring->exited.store(false, ::std::memory_order_relaxed);
+
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			ring->next = _rings;
+			_rings = ring;
+			return ring;
+		}
+
+		void Tracer::Record(void* fn, unsigned long long flags) {
+			if (!_enabled.load(::std::memory_order_relaxed)) {
+				return;
+			}
+
+			Ring* ring = _ring;
+			if (ring == 0) {
+				ring = _ring = _owner.ring = NewRing();
+			} else if (ring == &_retired) {
+				return;
+			}
+
+			const unsigned long long head =
+					ring->head.load(::std::memory_order_relaxed);
+			Event& event = ring->events[head & ring->mask];
+			event.fn = fn;
+			event.stamp = Cycles() | flags;
+			ring->head.store(head + 1, ::std::memory_order_release);
+		}
+
+		void Tracer::WriteName(::std::ostream& os, void* fn, bool symbolize) {
+			Dl_info info;
+			if (::dladdr(fn, &info) == 0 || info.dli_fname == 0) {
+				os << fn;
+				return;
+			}
+
+			if (symbolize && info.dli_sname != 0) {
+				int status = -1;
+				char* demangled = abi::__cxa_demangle(info.dli_sname, 0, 0,
+						&status);
+				const char* name = status == 0 ? demangled : info.dli_sname;
+				for (const char* cptr = name; *cptr != 0; ++cptr) {
+					if (*cptr == '"' || *cptr == '\\') {
+						os << '\\';
+					}
+					os << *cptr;
+				}
+				::std::free(demangled);
+				return;
+			}
+
+			// module+offset is what addr2line -e module offset expects
+			os << info.dli_fname << "+0x" << ::std::hex
+					<< (static_cast<char*>(fn) -
+					static_cast<char*>(info.dli_fbase)) << ::std::dec;
+		}
+
+		void Tracer::Capacity(::std::size_t events) {
+			_capacity.store(events != 0 ? events : 1,
+					::std::memory_order_relaxed);
+		}
+
+		void Tracer::Start() {
+			_start_cycles = Cycles();
+			_start_time = ::std::chrono::steady_clock::now();
+			_enabled.store(true, ::std::memory_order_release);
+		}
+
+		void Tracer::Stop() {
+			_enabled.store(false, ::std::memory_order_release);
+		}
+
+		void Tracer::Dump(::std::ostream& os, bool symbolize) {
+			const unsigned long long end_cycles = Cycles();
+			const double elapsed_us = ::std::chrono::duration<double,
+					::std::micro>(::std::chrono::steady_clock::now() -
+					_start_time).count();
+			const double cycles_per_us = elapsed_us > 0 ?
+					(end_cycles - _start_cycles) / elapsed_us : 1;
+
+			::std::map<void*, ::std::string> names;
+			const long pid = ::getpid();
+
+			// timestamps are written fixed-point; the caller's
+			// formatting is put back afterwards
+			const ::std::ios_base::fmtflags flags = os.flags();
+			const ::std::streamsize precision = os.precision();
+			os.setf(::std::ios_base::fixed, ::std::ios_base::floatfield);
+			os.precision(3);
+
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			os << "{\"traceEvents\":[";
+			bool first = true;
+			for (Ring* ring = _rings; ring != 0; ring = ring->next) {
+				const unsigned long long head =
+						ring->head.load(::std::memory_order_acquire);
+				const unsigned long long cleared =
+						ring->cleared.load(::std::memory_order_relaxed);
+				const unsigned long long size = ring->mask + 1;
+				unsigned long long i = head > size ? head - size : 0;
+				if (i < cleared) {
+					i = cleared;
+				}
+				for (; i < head; ++i) {
+					const Event& event = ring->events[i & ring->mask];
+					const unsigned long long stamp = event.stamp & ~EXIT_BIT;
+
+					::std::map<void*, ::std::string>::iterator name =
+							names.find(event.fn);
+					if (name == names.end()) {
+						::std::ostringstream ns;
+						WriteName(ns, event.fn, symbolize);
+						name = names.insert(::std::make_pair(event.fn,
+								ns.str())).first;
+					}
+
+					os << (first ? "\n" : ",\n") << "{\"ph\":\""
+							<< ((event.stamp & EXIT_BIT) != 0 ? 'E' : 'B')
+							<< "\",\"pid\":" << pid << ",\"tid\":"
+							<< ring->tid << ",\"ts\":"
+							<< (static_cast<double>(stamp) -
+							static_cast<double>(_start_cycles)) / cycles_per_us
+							<< ",\"name\":\"" << name->second << "\"}";
+					first = false;
+				}
+			}
+			os << "\n]}\n";
+
+			os.flags(flags);
+			os.precision(precision);
+		}
+
+		void Tracer::Clear() {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			Ring** link = &_rings;
+			while (*link != 0) {
+				Ring* ring = *link;
+				if (ring->exited.load(::std::memory_order_acquire)) {
+					*link = ring->next;
+					delete[] ring->events;
+					delete ring;
+				} else {
+					ring->cleared.store(
+							ring->head.load(::std::memory_order_acquire),
+							::std::memory_order_relaxed);
+					link = &ring->next;
+				}
+			}
+		}
+
+	} // namespace _private
+
+	EASY_NO_INSTRUMENT void Capacity(::std::size_t events) {
+		_private::Tracer::Capacity(events);
+	}
+
+	EASY_NO_INSTRUMENT void Start() {
+		_private::Tracer::Start();
+	}
+
+	EASY_NO_INSTRUMENT void Stop() {
+		_private::Tracer::Stop();
+	}
+
+	EASY_NO_INSTRUMENT void Dump(::std::ostream& os, bool symbolize) {
+		_private::Tracer::Dump(os, symbolize);
+	}
+
+	EASY_NO_INSTRUMENT void Clear() {
+		_private::Tracer::Clear();
+	}
+
+} // namespace functrace
+} // namespace easylogger
+
+extern "C" {
+
+	EASY_NO_INSTRUMENT void __cyg_profile_func_enter(void* this_fn,
+			void* call_site) {
+		(void)call_site;
+		::easylogger::functrace::_private::Tracer::Record(this_fn, 0);
+	}
+
+	EASY_NO_INSTRUMENT void __cyg_profile_func_exit(void* this_fn,
+			void* call_site) {
+		(void)call_site;
+		::easylogger::functrace::_private::Tracer::Record(this_fn,
+				::easylogger::functrace::_private::Tracer::EXIT_BIT);
+	}
+
+} // extern "C"
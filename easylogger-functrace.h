@@ -0,0 +1,70 @@
+//! \file easylogger-functrace.h
+//!
+//! Compiler-instrumented function tracing for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_FUNCTRACE_H)
+#define EASYLOGGER_FUNCTRACE_H
+
+#include <iosfwd>
+#include <cstddef>
+
+namespace easylogger {
+
+	//! Function tracing driven by -finstrument-functions
+	//!
+	//! Link easylogger-functrace.cc into a program and compile the
+	//! code to be traced with -finstrument-functions.  The compiler
+	//! then calls hooks on every function entry and exit, which record
+	//! the raw function address and a cycle counter timestamp into a
+	//! fixed-size ring owned by the calling thread.  Nothing is
+	//! formatted, locked or allocated on that path; recording costs a
+	//! few stores.  When a ring is full the oldest events are
+	//! overwritten, so the rings always hold the most recent history.
+	//!
+	//! Addresses are only resolved when the trace is dumped.  Dump()
+	//! writes Chrome trace event JSON (loadable by chrome://tracing and
+	//! Perfetto) naming each function by module and offset, which
+	//! addr2line can symbolize offline; passing symbolize resolves
+	//! names in-process with dladdr() instead.
+	//!
+	//! easylogger-functrace.cc itself must be compiled without
+	//! -finstrument-functions.
+	namespace functrace {
+
+		//! Set the ring capacity for threads that have not traced yet
+		//!
+		//! \param events Events per thread; rounded up to a power of two.
+		void Capacity(::std::size_t events);
+
+		//! Start recording function entries and exits
+		void Start();
+
+		//! Stop recording function entries and exits
+		void Stop();
+
+		//! Write all recorded events in Chrome trace event format
+		//!
+		//! Tracing should be stopped while dumping.  The formatting
+		//! flags and precision of os are left as they were.
+		//!
+		//! \param os Stream to write the trace to.
+		//! \param symbolize Resolve symbol names with dladdr().
+		void Dump(::std::ostream& os, bool symbolize = false);
+
+		//! Discard all recorded events and release rings of threads
+		//! that have exited
+		//!
+		//! May be called while tracing; events recorded concurrently
+		//! may or may not be discarded.
+		void Clear();
+
+	} // namespace functrace
+
+} // namespace easylogger
+
+#endif
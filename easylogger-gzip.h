@@ -0,0 +1,440 @@
+//! \file easylogger-gzip.h
+//!
+//! Compressed file sink for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Programs using this header must link with zlib (-lz).
+
+#if !defined(EASYLOGGER_GZIP_H)
+#define EASYLOGGER_GZIP_H
+
+#include "easylogger.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace easylogger {
+
+	//! Sink compressing records into a gzip file of independent blocks
+	//!
+	//! Records are gathered into a block, which is compressed as a
+	//! complete gzip member and appended to the file with a single
+	//! write() once it reaches the block size, once its first record is
+	//! older than the block age, and on Flush().  Concatenated members
+	//! form a valid gzip file, so zcat and friends read the whole log,
+	//! and a crash loses at most the block being gathered.
+	//!
+	//! After each block, a line is appended to an index file named
+	//! after the log with ".idx" added:
+	//!
+	//!     <offset> <size> <text offset> <text size> <time>
+	//!
+	//! giving the block's position in the compressed file, its position
+	//! in the uncompressed text, and the time(2) its first record was
+	//! written, which is also the modification time in the block's gzip
+	//! header.  A reader can seek to any block and inflate it alone.
+	//! A block whose index line cannot be written is cut off again and
+	//! its records are dropped, so the index always covers the file.
+	//!
+	//! When an existing log is opened, a partial line at the end of the
+	//! index is removed, and the members after the last indexed block
+	//! are inflated: complete ones are added to the index, and the first
+	//! one cut short by a crash is truncated away together with anything
+	//! after it.  A missing or damaged index is rebuilt the same way from
+	//! the start of the file.  Nothing is truncated if the index cannot
+	//! be written; the sink then stays closed.
+	//!
+	//! The sink may be shared by Loggers writing from several threads.
+	class GzipFileSink : public Sink {
+	public:
+		//! Open a compressed file for appending
+		//!
+		//! \param path Path of file; it is created if it does not exist.
+		//! \param compression zlib compression level, 1 to 9.
+		inline explicit GzipFileSink(const ::std::string& path,
+				int compression = 6);
+
+		inline ~GzipFileSink();
+
+		//! Check if the file was opened successfully
+		//!
+		//! \returns true if file is open
+		bool IsOpen() const { return _fd >= 0; }
+
+		//! Set when blocks are written
+		//!
+		//! Larger blocks compress better; smaller and younger blocks
+		//! reach the disk, and tailing readers, sooner.  The defaults
+		//! are 256KB and 5 seconds.  The age is only checked when a
+		//! record arrives, so an idle sink holds its block until Flush().
+		//!
+		//! \param bytes Uncompressed size at which a block is written.
+		//! \param age Age of its first record at which a block is written.
+		void Blocks(::std::size_t bytes, ::std::chrono::seconds age) {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			_block_size = bytes;
+			_max_age = age;
+		}
+
+		//! Get the number of records that could not be written
+		//!
+		//! \returns Count of dropped records.
+		unsigned long long Dropped() {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			return _dropped;
+		}
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		//! Add the records of a batch to the block under one lock
+		inline bool WriteBatch(const LogRecord* records, const char* text,
+				const ::std::size_t* lengths, ::std::size_t count);
+
+		inline void Flush();
+
+	private:
+		GzipFileSink(const GzipFileSink&);
+		GzipFileSink& operator=(const GzipFileSink&);
+
+		//! Truncate a crashed block and find where the log ends
+		inline void Recover();
+
+		//! Index the complete members from _offset to size and truncate
+		//! what follows them
+		inline void Scan(unsigned long long size);
+
+		//! Append the index line of the block at the end of the log
+		//!
+		//! On failure, the index is cut back to its previous size.
+		//!
+		//! \returns true if the line was written.
+		inline bool IndexBlock(unsigned long long size,
+				unsigned long long text_size, ::std::time_t time);
+
+		//! Compress and write the gathered block; caller holds the lock
+		inline void WriteBlock();
+
+		//! Add records to the block; caller holds the lock
+		inline bool Gather(const char* text, ::std::size_t length,
+				unsigned long records);
+
+		//! Write all of a text to a descriptor
+		static inline bool WriteAll(int fd, const char* text,
+				::std::size_t length);
+
+		::std::mutex _lock;
+
+		int _fd;
+
+		int _index;
+
+		z_stream _zs;
+
+		bool _deflating;
+
+		::std::size_t _block_size;
+
+		::std::chrono::seconds _max_age;
+
+		//! Uncompressed text of the current block
+		::std::string _block;
+
+		::std::vector<char> _out;
+
+		unsigned long _records;
+
+		::std::chrono::steady_clock::time_point _first;
+
+		::std::time_t _first_time;
+
+		//! End of the last block in the compressed file
+		unsigned long long _offset;
+
+		//! End of the last block in the uncompressed text
+		unsigned long long _text_offset;
+
+		//! Size of the index file
+		unsigned long long _index_size;
+
+		unsigned long long _dropped;
+	};
+
+	GzipFileSink::GzipFileSink(const ::std::string& path, int compression) :
+			_fd(-1), _index(-1), _deflating(false), _block_size(256 * 1024),
+			_max_age(5), _records(0), _first_time(0), _offset(0),
+			_text_offset(0), _index_size(0), _dropped(0) {
+		_zs.zalloc = Z_NULL;
+		_zs.zfree = Z_NULL;
+		_zs.opaque = Z_NULL;
+		// window bits of 15 + 16 selects a gzip header and trailer
+		_deflating = ::deflateInit2(&_zs, compression, Z_DEFLATED, 15 + 16, 8,
+				Z_DEFAULT_STRATEGY) == Z_OK;
+
+		// readable so that Recover() can check the blocks after the index
+		_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+				0644);
+		_index = ::open((path + ".idx").c_str(),
+				O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (!_deflating || _index < 0) {
+			if (_fd >= 0) {
+				::close(_fd);
+			}
+			_fd = -1;
+			return;
+		}
+		Recover();
+	}
+
+	GzipFileSink::~GzipFileSink() {
+		if (_fd >= 0) {
+			WriteBlock();
+			::close(_fd);
+		}
+		if (_index >= 0) {
+			::close(_index);
+		}
+		if (_deflating) {
+			::deflateEnd(&_zs);
+		}
+	}
+
+	void GzipFileSink::Recover() {
+		struct stat data, index;
+		if (::fstat(_fd, &data) != 0 || ::fstat(_index, &index) != 0) {
+			::close(_fd);
+			_fd = -1;
+			return;
+		}
+
+		// the last complete line of the index describes the last block
+		// known to be complete; lines are shorter than 128 bytes, so the
+		// tail holds it even after a partial line
+		char tail[256];
+		const off_t start = index.st_size > static_cast<off_t>(sizeof(tail) - 1) ?
+				index.st_size - static_cast<off_t>(sizeof(tail) - 1) : 0;
+		ssize_t end = ::pread(_index, tail, index.st_size - start, start);
+		while (end > 0 && tail[end - 1] != '\n') {
+			--end;
+		}
+		if (end > 0) {
+			tail[end - 1] = 0;
+			ssize_t begin = end - 1;
+			while (begin > 0 && tail[begin - 1] != '\n') {
+				--begin;
+			}
+			unsigned long long offset, length, text_offset, text_length;
+			if ((begin > 0 || start == 0) &&
+					::std::sscanf(tail + begin, "%llu %llu %llu %llu", &offset,
+						&length, &text_offset, &text_length) == 4 &&
+					offset + length <= static_cast<unsigned long long>(
+						data.st_size)) {
+				_offset = offset + length;
+				_text_offset = text_offset + text_length;
+				_index_size = start + end;
+			}
+		}
+
+		// without a usable line, the index is rebuilt from the start
+		if (static_cast<unsigned long long>(index.st_size) != _index_size &&
+				::ftruncate(_index, _index_size) != 0) {
+			::close(_fd);
+			_fd = -1;
+			return;
+		}
+		if (static_cast<unsigned long long>(data.st_size) > _offset) {
+			Scan(data.st_size);
+		}
+	}
+
+	void GzipFileSink::Scan(unsigned long long size) {
+		z_stream zs;
+		zs.zalloc = Z_NULL;
+		zs.zfree = Z_NULL;
+		zs.opaque = Z_NULL;
+		zs.next_in = Z_NULL;
+		zs.avail_in = 0;
+		if (::inflateInit2(&zs, 15 + 16) != Z_OK) {
+			::close(_fd);
+			_fd = -1;
+			return;
+		}
+		gz_header header = gz_header();
+		::inflateGetHeader(&zs, &header);
+
+		// inflate member by member, indexing each one that ends
+		char in[16384];
+		char out[16384];
+		unsigned long long read = _offset;
+		unsigned long long text = 0;
+		for (;;) {
+			if (zs.avail_in == 0) {
+				const ::std::size_t want = size - read < sizeof(in) ?
+						static_cast< ::std::size_t>(size - read) : sizeof(in);
+				const ssize_t rs = want != 0 ? ::pread(_fd, in, want, read) : 0;
+				if (rs <= 0) {
+					break;
+				}
+				read += rs;
+				zs.next_in = reinterpret_cast<Bytef*>(in);
+				zs.avail_in = static_cast<uInt>(rs);
+			}
+			zs.next_out = reinterpret_cast<Bytef*>(out);
+			zs.avail_out = sizeof(out);
+			const int rs = ::inflate(&zs, Z_NO_FLUSH);
+			text += sizeof(out) - zs.avail_out;
+			if (rs == Z_STREAM_END) {
+				const unsigned long long end = read - zs.avail_in;
+				if (!IndexBlock(end - _offset, text, header.time)) {
+					// keep the blocks that cannot be indexed
+					::inflateEnd(&zs);
+					::close(_fd);
+					_fd = -1;
+					return;
+				}
+				text = 0;
+				::inflateReset(&zs);
+				header = gz_header();
+				::inflateGetHeader(&zs, &header);
+			} else if (rs != Z_OK && rs != Z_BUF_ERROR) {
+				break;
+			}
+		}
+		::inflateEnd(&zs);
+
+		if (size > _offset && ::ftruncate(_fd, _offset) != 0) {
+			::close(_fd);
+			_fd = -1;
+		}
+	}
+
+	bool GzipFileSink::IndexBlock(unsigned long long size,
+			unsigned long long text_size, ::std::time_t time) {
+		char line[128];
+		const int length = ::std::snprintf(line, sizeof(line),
+				"%llu %llu %llu %llu %lld\n", _offset, size, _text_offset,
+				text_size, static_cast<long long>(time));
+		if (!WriteAll(_index, line, length)) {
+			// a partial line would hide the blocks written after it
+			if (::ftruncate(_index, _index_size) != 0) {
+				::close(_index);
+				_index = -1;
+			}
+			return false;
+		}
+		_index_size += length;
+		_offset += size;
+		_text_offset += text_size;
+		return true;
+	}
+
+	bool GzipFileSink::Write(const LogRecord&, const char* text,
+			::std::size_t length) {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		return Gather(text, length, 1);
+	}
+
+	bool GzipFileSink::WriteBatch(const LogRecord*, const char* text,
+			const ::std::size_t* lengths, ::std::size_t count) {
+		::std::size_t length = 0;
+		for (::std::size_t i = 0; i != count; ++i) {
+			length += lengths[i];
+		}
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		return Gather(text, length, count);
+	}
+
+	bool GzipFileSink::Gather(const char* text, ::std::size_t length,
+			unsigned long records) {
+		if (_fd < 0) {
+			_dropped += records;
+			return false;
+		}
+
+		const ::std::chrono::steady_clock::time_point now =
+				::std::chrono::steady_clock::now();
+		if (_records == 0) {
+			_first = now;
+			_first_time = ::std::time(0);
+		}
+		_block.append(text, length);
+		_records += records;
+
+		if (_block.size() >= _block_size || now - _first >= _max_age) {
+			WriteBlock();
+		}
+		return true;
+	}
+
+	void GzipFileSink::Flush() {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		if (_fd >= 0) {
+			WriteBlock();
+		}
+	}
+
+	void GzipFileSink::WriteBlock() {
+		if (_records == 0) {
+			return;
+		}
+
+		::deflateReset(&_zs);
+		gz_header header = gz_header();
+		header.time = static_cast<uLong>(_first_time);
+		header.os = 3;	// Unix
+		::deflateSetHeader(&_zs, &header);
+		_out.resize(::deflateBound(&_zs, _block.size()));
+		_zs.next_in = reinterpret_cast<Bytef*>(&_block[0]);
+		_zs.avail_in = static_cast<uInt>(_block.size());
+		_zs.next_out = reinterpret_cast<Bytef*>(&_out[0]);
+		_zs.avail_out = static_cast<uInt>(_out.size());
+		const bool done = ::deflate(&_zs, Z_FINISH) == Z_STREAM_END;
+		const ::std::size_t size = _out.size() - _zs.avail_out;
+
+		if (!done || _index < 0 || !WriteAll(_fd, &_out[0], size) ||
+				!IndexBlock(size, _block.size(), _first_time)) {
+			// cut off a partly written or unindexed member so the next
+			// one follows the last complete block
+			if (::ftruncate(_fd, _offset) != 0) {
+				::close(_fd);
+				_fd = -1;
+			}
+			_dropped += _records;
+		}
+
+		_block.clear();
+		_records = 0;
+	}
+
+	bool GzipFileSink::WriteAll(int fd, const char* text,
+			::std::size_t length) {
+		while (length != 0) {
+			const ssize_t rs = ::write(fd, text, length);
+			if (rs < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				return false;
+			}
+			text += rs;
+			length -= rs;
+		}
+		return true;
+	}
+
+} // namespace easylogger
+
+#endif
@@ -1,103 +1,1299 @@
+//! \file easylogger-impl.h
+//!
+//! Implementation of Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Included by easylogger.h in header-only builds, and by
+//! easylogger.cc when building the library.
+
+#if !defined(EASYLOGGER_IMPL_H)
+#define EASYLOGGER_IMPL_H
+
+#include "easylogger.h"
+#include "easylogger-private.h"
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <new>
+#include <set>
+#include <thread>
+
+#if !defined(EASYLOGGER_HAVE_BACKTRACE) && defined(__has_include)
+# if __has_include(<execinfo.h>) && __has_include(<dlfcn.h>) && \
+		__has_include(<cxxabi.h>)
+#  define EASYLOGGER_HAVE_BACKTRACE 1
+# endif
+#endif
+#if EASYLOGGER_HAVE_BACKTRACE
+# include <cxxabi.h>
+# include <dlfcn.h>
+# include <execinfo.h>
+#endif
+
+// return address of the current function, marking where a captured
+// stack leaves Easylogger
+#if defined(__GNUC__)
+# define _EASY_RETURN_ADDRESS __builtin_return_address(0)
+#else
+# define _EASY_RETURN_ADDRESS 0
+#endif
+#if defined(__linux__)
+# include <time.h>
+#endif
+
 namespace easylogger {
 
-	bool Logger::IsLevel(LogLevel level) const {
-		return _level <= level || (_parent != 0 && _parent->IsLevel(level));
+	namespace _private {
+
+		//! Registry of per-thread call site shards
+		//!
+		//! \internal
+		struct SiteRegistry {
+			//! Totals of a call site, as kept for exited threads
+			struct Totals {
+				unsigned long long records;
+				unsigned long long bytes;
+				unsigned long long cycles;
+			};
+
+			//! Lock held while walking or modifying the registry
+			::std::mutex lock;
+
+			//! First registered shard
+			SiteShard* head;
+
+			//! Counters merged from shards of exited threads
+			::std::map<const CallSite*, Totals> retired;
+
+			//! Request to summarize or write the sites of a file
+			struct Rule {
+				::std::string file;
+				unsigned int line;
+				bool summarize;
+			};
+
+			//! First registered call site
+			CallSite* sites;
+
+			//! Summary rules, applied in order to each site
+			::std::vector<Rule> rules;
+
+			//! Last summary created; the list is read without the lock
+			::std::atomic<SiteSummary*> summaries;
+
+			//! Create the summary of a site; caller holds the lock
+			//!
+			//! The first summary arranges for the pending summary lines
+			//! to be written at exit.
+			SiteSummary* NewSummary() {
+				SiteSummary* summary = new SiteSummary;
+				summary->next = summaries.load(::std::memory_order_relaxed);
+				if (summary->next == 0) {
+					::std::atexit(&FlushSummaries);
+				}
+				summaries.store(summary, ::std::memory_order_release);
+				return summary;
+			}
+		};
+
+		//! Get a cheap monotonic time for summary intervals
+		//!
+		//! On Linux the coarse clock is read without a system call and
+		//! is as precise as the scheduler tick, which is plenty for
+		//! intervals of seconds.
+		//!
+		//! \internal
+		//! \returns Time in nanoseconds
+		inline long long CoarseNow() {
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_COARSE)
+			struct timespec ts;
+			::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+			return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#else
+			return Now();
+#endif
+		}
+
+		//! Check if a summary rule's file matches a call site's file
+		//!
+		//! \internal
+		//! \param rule File name, or trailing path components of it.
+		//! \param file File name of the call site.
+		//! \returns true if file is rule or ends with a '/' and rule
+		inline bool MatchesFile(const ::std::string& rule, const char* file) {
+			const ::std::size_t length = ::std::strlen(file);
+			if (rule.size() > length || rule.compare(0, ::std::string::npos,
+					file + length - rule.size()) != 0) {
+				return false;
+			}
+			return rule.size() == length || rule.empty() ||
+					file[length - rule.size() - 1] == '/' ||
+					rule[0] == '/';
+		}
+
+		//! Registry of used Loggers and interned strings
+		//!
+		//! \internal
+		struct LoggerRegistry {
+			//! Lock held while walking or modifying the registry
+			::std::mutex lock;
+
+			//! First registered Logger
+			Logger* head;
+
+			//! Interned strings; never freed, as Loggers may use them
+			//! during exit
+			::std::set< ::std::string>* strings;
+		};
+
+	} // namespace _private
+
+	// the registries are never destroyed, as Loggers with static
+	// storage and exiting threads use them during exit
+
+	_private::LoggerRegistry& _private::Loggers() {
+		static LoggerRegistry* registry = new LoggerRegistry();
+		return *registry;
+	}
+
+	const char* _private::Intern(const ::std::string& text) {
+		LoggerRegistry& registry = Loggers();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		if (registry.strings == 0) {
+			registry.strings = new ::std::set< ::std::string>;
+		}
+		return registry.strings->insert(text).first->c_str();
+	}
+
+	::std::ostream& _private::DefaultStream() {
+		return ::std::cout;
+	}
+
+	long long _private::Now() {
+		return ::std::chrono::duration_cast< ::std::chrono::nanoseconds>(
+				::std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	_private::ReaderRegistry& _private::Readers() {
+		static ReaderRegistry* registry = new ReaderRegistry();
+		return *registry;
+	}
+
+	namespace _private {
+
+		//! Get the reader of the calling thread, if it has one
+		//!
+		//! Unlike ThreadReader(), safe to call after the thread's
+		//! thread_local objects are destroyed, as during exit.
+		//!
+		//! \internal
+		//! \returns Reader of the thread; NULL if none
+		inline Reader*& CurrentReader() {
+			static thread_local Reader* reader = 0;
+			return reader;
+		}
+
+	} // namespace _private
+
+	_private::Reader::Reader() : _epoch(0), _nesting(0) {
+		ReaderRegistry& registry = Readers();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		_next = registry.head;
+		registry.head = this;
+		CurrentReader() = this;
+	}
+
+	_private::Reader::~Reader() {
+		CurrentReader() = 0;
+		ReaderRegistry& registry = Readers();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		Reader** link = &registry.head;
+		while (*link != this) {
+			link = &(*link)->_next;
+		}
+		*link = _next;
+	}
+
+	_private::Reader& _private::ThreadReader() {
+		static thread_local Reader reader;
+		return reader;
+	}
+
+	void _private::Synchronize() {
+		const unsigned long long epoch = ReadEpoch().fetch_add(1,
+				::std::memory_order_seq_cst) + 1;
+		const Reader* self = CurrentReader();
+
+		ReaderRegistry& registry = Readers();
+		::std::unique_lock< ::std::mutex> guard(registry.lock);
+		Reader* reader = registry.head;
+		while (reader != 0) {
+			const unsigned long long entered = reader->_epoch.load(
+					::std::memory_order_seq_cst);
+			if (reader == self || entered == 0 || entered >= epoch) {
+				reader = reader->_next;
+				continue;
+			}
+			// let threads start and exit while waiting; the list may
+			// change meanwhile, so check it again from the start
+			guard.unlock();
+			::std::this_thread::yield();
+			guard.lock();
+			reader = registry.head;
+		}
+	}
+
+	Logger::Logger(const ::std::string& name) :
+			_name(_private::Intern(name)), _parent(0), _level(UNREGISTERED),
+			_backtrace(LEVEL_NONE), _stream(0), _detached(false), _sink(0),
+			_format("[%F:%C %P] %N %L: %S"), _next(0), _link(0) {}
+
+	Logger::Logger(const ::std::string& name, Logger& parent) :
+			_name(_private::Intern(name)), _parent(&parent),
+			_level(UNREGISTERED), _backtrace(LEVEL_NONE), _stream(0),
+			_detached(false), _sink(0), _format(0), _next(0), _link(0) {}
+
+	Logger::~Logger() {
+		// a Logger never used cannot be in use by another thread
+		if (_level.load(::std::memory_order_relaxed) == UNREGISTERED) {
+			return;
+		}
+
+		{
+			_private::LoggerRegistry& registry = _private::Loggers();
+			::std::lock_guard< ::std::mutex> guard(registry.lock);
+			*_link = _next;
+			if (_next != 0) {
+				_next->_link = _link;
+			}
+		}
+
+		// summarized call sites keep the last Logger they logged to;
+		// only sites ever summarized have a summary to clear
+		for (_private::SiteSummary* summary = _private::Sites().summaries.load(
+				::std::memory_order_acquire); summary != 0;
+				summary = summary->next) {
+			Logger* logger = this;
+			summary->logger.compare_exchange_strong(logger, 0,
+					::std::memory_order_relaxed);
+		}
+
+		_private::Synchronize();
+	}
+
+	int Logger::Register() const {
+		_private::LoggerRegistry& registry = _private::Loggers();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		int current = _level.load(::std::memory_order_relaxed);
+		if (current == UNREGISTERED) {
+			_next = registry.head;
+			if (_next != 0) {
+				_next->_link = &_next;
+			}
+			_link = &registry.head;
+			registry.head = const_cast<Logger*>(this);
+			current = LEVEL_INFO;
+			_level.store(current, ::std::memory_order_relaxed);
+		}
+		return current;
+	}
+
+	LogLevel Logger::Level(LogLevel level) {
+		if (_level.load(::std::memory_order_relaxed) == UNREGISTERED) {
+			Register();
+		}
+		_level.store(level, ::std::memory_order_relaxed);
+		return level;
+	}
+
+	Logger* FindLogger(const char* name) {
+		_private::LoggerRegistry& registry = _private::Loggers();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		for (Logger* logger = registry.head; logger != 0;
+				logger = logger->_next) {
+			if (::std::strcmp(logger->Name(), name) == 0) {
+				return logger;
+			}
+		}
+		return 0;
+	}
+
+	LogLevel Logger::Backtrace(LogLevel level) {
+#if EASYLOGGER_HAVE_BACKTRACE
+		// the first backtrace() loads the unwinder; do it up front
+		if (level != LEVEL_NONE) {
+			void* frame;
+			::backtrace(&frame, 1);
+		}
+#endif
+		return _backtrace = level;
+	}
+
+	bool Logger::IsBacktrace(LogLevel level) const {
+		return _backtrace <= level ||
+				(_parent != 0 && _parent->IsBacktrace(level));
 	}
 
 	_private::LogSink Logger::Log(LogLevel level, const char* file,
 			unsigned int line, const char* func) {
-		return _private::LogSink(this, level, file, line, func);
+		_private::LogSink sink(this, level, file, line, func);
+#if EASYLOGGER_HAVE_PMR
+		sink.Memory(Memory());
+#endif
+		if (IsBacktrace(level)) {
+			sink.CaptureStack(_EASY_RETURN_ADDRESS);
+		}
+		return sink;
+	}
+
+	_private::LogSink Logger::Log(LogLevel level,
+			const _private::CallSite& site) {
+		_private::LogSink sink(this, level, site.file, site.line, site.func,
+				&site);
+#if EASYLOGGER_HAVE_PMR
+		sink.Memory(Memory());
+#endif
+		if (IsBacktrace(level)) {
+			sink.CaptureStack(_EASY_RETURN_ADDRESS);
+		}
+		return sink;
 	}
 
 	::std::ostream& Logger::Stream(::std::ostream& stream) {
 		_stream = &stream;
+		_detached = false;
 		return *_stream;
 	}
 
-	const ::std::string& Logger::Format(const ::std::string& format) {
-		return _format = format;
+	const char* Logger::Format(const ::std::string& format) {
+		return _format = _private::Intern(format);
 	}
 
-	void Logger::WriteLog(LogLevel level, Logger* logger, const char* file,
-			unsigned int line, const char* func, const char* message) {
-		if (_level <= level && _stream != 0) {
-			const char* cptr = _format.c_str();
-			while (*cptr != 0) {
-				if (*cptr == '%') {
-					switch (*++cptr) {
-					// % at end of stream
-					case 0:
-						*_stream << '%' << ::std::endl;
-						return;
-					// %% - literal escape
-					case '%':
-						*_stream << '%';
-						break;
-					// %F - file name
-					case 'F':
-						*_stream << file;
-						break;
-					// %C - line counter
-					case 'C':
-						if (line != 0) {
-							*_stream << line;
-						} else {
-							*_stream << '?';
-						}
-						break;
-					// %P - function name
-					case 'P':
-						*_stream << func;
-						break;
-					// %N - logger name
-					case 'N':
-						*_stream << logger->Name();
-						break;
-					// %L - log level
-					case 'L':
-						switch (level) {
-						case LEVEL_TRACE: *_stream << "TRACE"; break;
-						case LEVEL_DEBUG: *_stream << "DEBUG"; break;
-						case LEVEL_INFO: *_stream << "INFO"; break;
-						case LEVEL_WARNING: *_stream << "WARNING"; break;
-						case LEVEL_ERROR: *_stream << "ERROR"; break;
-						case LEVEL_FATAL: *_stream << "FATAL"; break;
-						default: *_stream << "UNKNOWN"; break;
-						}
-						break;
-					// %M - message
-					case 'S':
-						*_stream << message;
-						break;
+#if EASYLOGGER_HAVE_PMR
+	::std::pmr::memory_resource& Logger::Memory() const {
+		const Logger* logger = this;
+		while (logger->_memory == 0) {
+			if (logger->_parent == 0) {
+				return *::std::pmr::get_default_resource();
+			}
+			logger = logger->_parent;
+		}
+		return *logger->_memory;
+	}
+#endif
+
+	Sink& Logger::Output(Sink& sink) {
+		_sink = &sink;
+		return *_sink;
+	}
+
+	void Logger::Flush() {
+		::std::ostream* stream = Destination();
+		if (stream != 0) {
+			stream->flush();
+		}
+		if (_sink != 0) {
+			_sink->Flush();
+		}
+		if (_parent != 0) {
+			_parent->Flush();
+		}
+	}
+
+	void FormatRecord(::std::ostream& os, const LogRecord& record) {
+		const char* cptr = record.format;
+		while (*cptr != 0) {
+			if (*cptr == '%') {
+				switch (*++cptr) {
+				// % at end of stream
+				case 0:
+					os << '%';
+					return;
+				// %% - literal escape
+				case '%':
+					os << '%';
+					break;
+				// %F - file name
+				case 'F':
+					os << record.file;
+					break;
+				// %C - line counter
+				case 'C':
+					if (record.line != 0) {
+						os << record.line;
+					} else {
+						os << '?';
 					}
-				} else {
-					*_stream << *cptr;
+					break;
+				// %P - function name
+				case 'P':
+					os << record.func;
+					break;
+				// %N - logger name
+				case 'N':
+					os << record.logger->Name();
+					break;
+				// %L - log level
+				case 'L':
+					switch (record.level) {
+					case LEVEL_TRACE: os << "TRACE"; break;
+					case LEVEL_DEBUG: os << "DEBUG"; break;
+					case LEVEL_INFO: os << "INFO"; break;
+					case LEVEL_WARNING: os << "WARNING"; break;
+					case LEVEL_ERROR: os << "ERROR"; break;
+					case LEVEL_FATAL: os << "FATAL"; break;
+					default: os << "UNKNOWN"; break;
+					}
+					break;
+				// %M - message
+				case 'S':
+					os << record.message;
+					break;
 				}
+			} else {
+				os << *cptr;
+			}
+
+			++cptr;
+		}
+	}
+
+	void Logger::WriteLog(LogLevel level, Logger* logger, const char* file,
+			unsigned int line, const char* func, const char* message,
+			void* const* frames, int depth) {
+		if (Level() <= level) {
+			const LogRecord record = { level, logger, file, line, func,
+					message, frames, depth, Format() };
+			::std::ostream* stream = Destination();
+			if (stream != 0) {
+				FormatRecord(*stream, record);
+				_private::WriteStack(*stream, frames, depth);
+				*stream << ::std::endl;
+			}
+			if (_sink != 0 && _sink->Formats()) {
+				_sink->Write(record, 0, 0);
+			} else if (_sink != 0) {
+				_private::MessageBuf text;
+#if EASYLOGGER_HAVE_PMR
+				text.Memory(&logger->Memory());
+#endif
+				::std::ostream os(&text);
+				FormatRecord(os, record);
+				_private::WriteStack(os, frames, depth);
+				os << '\n';
+				_sink->Write(record, text.Text(), text.Size());
+			}
+		}
+		if (_parent != 0) {
+			_parent->WriteLog(level, logger, file, line, func, message,
+					frames, depth);
+		}
+	}
 
-				++cptr;
+	void Logger::WriteBatch(LogLevel level, Logger* logger, const char* file,
+			unsigned int line, const char* func, const char* messages,
+			const ::std::size_t* starts, ::std::size_t count) {
+		if (Level() <= level) {
+			const char* format = Format();
+#if EASYLOGGER_HAVE_PMR
+			::std::pmr::memory_resource& memory = logger->Memory();
+			::std::pmr::vector<LogRecord> records(count, LogRecord(), &memory);
+#else
+			::std::vector<LogRecord> records(count);
+#endif
+			for (::std::size_t i = 0; i != count; ++i) {
+				const LogRecord record = { level, logger, file, line, func,
+						messages + starts[i], 0, 0, format };
+				records[i] = record;
+			}
+
+			::std::ostream* stream = Destination();
+			if (stream != 0) {
+				for (::std::size_t i = 0; i != count; ++i) {
+					FormatRecord(*stream, records[i]);
+					*stream << '\n';
+				}
+				stream->flush();
+			}
+			if (_sink != 0 && _sink->Formats()) {
+				_sink->WriteBatch(&records[0], 0, 0, count);
+			} else if (_sink != 0) {
+				_private::MessageBuf text;
+#if EASYLOGGER_HAVE_PMR
+				text.Memory(&memory);
+				::std::pmr::vector< ::std::size_t> lengths(count, 0, &memory);
+#else
+				::std::vector< ::std::size_t> lengths(count);
+#endif
+				::std::ostream os(&text);
+				for (::std::size_t i = 0; i != count; ++i) {
+					const ::std::size_t before = text.Size();
+					FormatRecord(os, records[i]);
+					os << '\n';
+					lengths[i] = text.Size() - before;
+				}
+				_sink->WriteBatch(&records[0], text.Text(), &lengths[0], count);
 			}
-			*_stream << ::std::endl;
 		}
 		if (_parent != 0) {
-			_parent->WriteLog(level, logger, file, line, func, message);
+			_parent->WriteBatch(level, logger, file, line, func, messages,
+					starts, count);
+		}
+	}
+
+	Batch::Batch(Logger& logger, LogLevel level, const char* file,
+			unsigned int line, const char* func) : _text(0), _stream(0),
+			_logger(logger), _level(level), _file(file), _line(line),
+			_func(func), _active(logger.IsLevel(level)) {}
+
+	Batch::~Batch() {
+		Commit();
+#if EASYLOGGER_HAVE_PMR
+		if (_text != 0) {
+			::std::pmr::memory_resource* memory = _text->buf.Memory();
+			_text->~BatchText();
+			memory->deallocate(_text, sizeof(_private::BatchText),
+					alignof(_private::BatchText));
+		}
+#else
+		delete _text;
+#endif
+	}
+
+	::std::size_t Batch::Size() const {
+		return _text != 0 ? _text->starts.size() : 0;
+	}
+
+	_private::MessageStream& Batch::Add() {
+		if (_text == 0) {
+#if EASYLOGGER_HAVE_PMR
+			::std::pmr::memory_resource& memory = _logger.Memory();
+			_text = new (memory.allocate(sizeof(_private::BatchText),
+					alignof(_private::BatchText))) _private::BatchText(memory);
+#else
+			_text = new _private::BatchText;
+#endif
+			_stream = _private::MessageStream(&_text->os);
+		}
+
+		// end the previous message, so each can be passed as a C string
+		if (!_text->starts.empty()) {
+			_text->os.put(0);
+		}
+		_text->starts.push_back(_text->buf.Size());
+		return _stream;
+	}
+
+	void Batch::Commit() {
+		if (_text == 0 || _text->starts.empty()) {
+			return;
+		}
+		_logger.WriteBatch(_level, &_logger, _file, _line, _func,
+				_text->buf.Text(), &_text->starts[0], _text->starts.size());
+		_text->starts.clear();
+		_text->buf.Clear();
+	}
+
+	_private::ScopeRegistry& _private::Scopes() {
+		static ScopeRegistry* registry = new ScopeRegistry();
+		return *registry;
+	}
+
+	_private::ScopeStack::ScopeStack() : _depth(0) {
+		ScopeRegistry& registry = Scopes();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		_next = registry.head;
+		registry.head = this;
+	}
+
+	_private::ScopeStack::~ScopeStack() {
+		ScopeRegistry& registry = Scopes();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		ScopeStack** link = &registry.head;
+		while (*link != this) {
+			link = &(*link)->_next;
 		}
+		*link = _next;
+	}
+
+	_private::ScopeStack& _private::ThreadScopes() {
+		static thread_local ScopeStack stack;
+		return stack;
 	}
 
 	_private::Tracer::Tracer(Logger& logger, const char* file,
 			unsigned int line, const char* func, const char* name) :
-			_logger(logger), _file(file), _func(func), _name(name) {
-		_private::LogSink sink(_logger.Log(LEVEL_TRACE, _file, line, _func));
-		sink.Stream() << "Entering " << _name;
+			_logger(logger), _scopes(ThreadScopes()), _file(file),
+			_func(func), _name(name) {
+		_scopes.Push(_name);
+		_EASY_TRACE_PROBE(trace_enter, _logger, _file, line, _func, _name);
+		if (_logger.IsLevel(LEVEL_TRACE)) {
+			_private::LogSink sink(_logger.Log(LEVEL_TRACE, _file, line, _func));
+			sink.Stream() << "Entering " << _name;
+		}
 	}
 
 	_private::Tracer::~Tracer() {
-		_private::LogSink sink(_logger.Log(LEVEL_TRACE, _file, 0, _func));
-		sink.Stream() << "Exiting " << _name;
+		if (_logger.IsLevel(LEVEL_TRACE)) {
+			_private::LogSink sink(_logger.Log(LEVEL_TRACE, _file, 0, _func));
+			sink.Stream() << "Exiting " << _name;
+		}
+		_EASY_TRACE_PROBE(trace_exit, _logger, _file, 0, _func, _name);
+		_scopes.Pop();
+	}
+
+	_private::SlowScope*& _private::SlowScope::Current() {
+		static thread_local SlowScope* current = 0;
+		return current;
+	}
+
+	_private::SlowScope::SlowScope(Logger& logger, LogLevel level,
+			const char* file, unsigned int line, const char* func,
+			const char* name, unsigned long threshold) : _logger(logger),
+			_level(level), _file(file), _line(line), _func(func), _name(name), _threshold(threshold),
+			_start(Now()), _outer(Current()), _noted(0) {
+		Current() = this;
+	}
+
+	_private::SlowScope::~SlowScope() {
+		const unsigned long elapsed = static_cast<unsigned long>(
+				(Now() - _start) / 1000);
+		Current() = _outer;
+
+		if (elapsed < _threshold) {
+			return;
+		}
+
+		if (_outer != 0) {
+			if (_outer->_noted < MAX_NOTES) {
+				_outer->_note_names[_outer->_noted] = _name;
+				_outer->_note_times[_outer->_noted] = elapsed;
+			}
+			++_outer->_noted;
+		}
+
+		if (_logger.IsLevel(_level)) {
+			_private::LogSink sink(_logger.Log(_level, _file, _line, _func));
+			sink.Stream() << "Slow " << _name << ": " << elapsed << "us (limit "
+					<< _threshold << "us)";
+			for (unsigned int i = 0; i != _noted && i != MAX_NOTES; ++i) {
+				sink.Stream() << (i == 0 ? "; slow: " : ", ") << _note_names[i]
+						<< ' ' << _note_times[i] << "us";
+			}
+			if (_noted > MAX_NOTES) {
+				sink.Stream() << ", " << (_noted - MAX_NOTES) << " more";
+			}
+		}
+	}
+
+	_private::LogSink::LogSink(Logger* logger, LogLevel level,
+			const char* file, unsigned int line, const char* func,
+			const CallSite* site) : MessageStream(0), _logger(logger),
+			_level(level), _file(file), _line(line), _func(func), _site(site),
+			_start(0), _depth(0) {
+		static_assert(sizeof(MessageText) <= TEXT_SIZE &&
+				alignof(MessageText) <= alignof(::std::max_align_t),
+				"LogSink::TEXT_SIZE does not fit MessageText");
+		_os = &(new (_text) MessageText)->os;
+		if (_site != 0 && SiteStatsFlag().load(::std::memory_order_relaxed)) {
+			_start = Cycles();
+		}
+	}
+
+	_private::LogSink::LogSink(const LogSink& sink) : MessageStream(0),
+			_logger(sink._logger), _level(sink._level), _file(sink._file),
+			_line(sink._line), _func(sink._func), _site(sink._site),
+			_start(sink._start), _depth(sink._depth) {
+		MessageText* text = new (_text) MessageText;
+#if EASYLOGGER_HAVE_PMR
+		text->buf.Memory(reinterpret_cast<const MessageText*>(sink._text)->
+				buf.Memory());
+#endif
+		_os = &text->os;
+		for (int i = 0; i != _depth; ++i) {
+			_frames[i] = sink._frames[i];
+		}
+	}
+
+	void _private::LogSink::CaptureStack(void* caller) {
+#if EASYLOGGER_HAVE_BACKTRACE
+		// drop the frames of CaptureStack and Logger::Log, however they
+		// were inlined, by starting at the caller's return address; by
+		// default drop only CaptureStack's own frame
+		enum { SKIP = 4 };
+		void* frames[MAX_FRAMES + SKIP];
+		const int depth = ::backtrace(frames, MAX_FRAMES + SKIP);
+		int skip = 1;
+		for (int i = 1; i != depth && i != SKIP; ++i) {
+			if (frames[i] == caller) {
+				skip = i;
+				break;
+			}
+		}
+		for (_depth = 0; _depth != MAX_FRAMES && _depth + skip < depth;
+				++_depth) {
+			_frames[_depth] = frames[_depth + skip];
+		}
+#else
+		(void)caller;
+#endif
+	}
+
+#if EASYLOGGER_HAVE_PMR
+	void _private::LogSink::Memory(::std::pmr::memory_resource& memory) {
+		Text().buf.Memory(&memory);
+	}
+#endif
+
+	const char* _private::LogSink::Message() {
+		return Text().buf.Text();
 	}
 
 	_private::LogSink::~LogSink() {
+		MessageText& text = Text();
 		_logger->WriteLog(_level, _logger, _file, _line, _func,
-				_os.str().c_str());
+				text.buf.Text(), _frames, _depth);
+		if (_start != 0) {
+			ThreadSites().Count(_site, text.buf.Size(), Cycles() - _start);
+		}
+		text.~MessageText();
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(bool value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(char value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			signed char value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			unsigned char value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(short value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			unsigned short value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(int value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			unsigned int value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(long value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			unsigned long value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			long long value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			unsigned long long value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(float value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(double value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			long double value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			const char* value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			const void* value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageStream& _private::MessageStream::operator<<(
+			const ::std::string& value) {
+		*_os << value;
+		return *this;
+	}
+
+	_private::MessageBuf::~MessageBuf() {
+#if EASYLOGGER_HAVE_PMR
+		if (_heap != 0) {
+			(_memory != 0 ? _memory : ::std::pmr::get_default_resource())->
+					deallocate(_heap, epptr() - pbase() + 1, 1);
+		}
+#else
+		::std::free(_heap);
+#endif
+	}
+
+	_private::MessageBuf::int_type _private::MessageBuf::overflow(int_type ch) {
+		if (traits_type::eq_int_type(ch, traits_type::eof())) {
+			return traits_type::not_eof(ch);
+		}
+
+		// grow geometrically, keeping room for the terminator
+		const ::std::size_t size = Size();
+		const ::std::size_t capacity = (size + 1) * 2;
+#if EASYLOGGER_HAVE_PMR
+		::std::pmr::memory_resource* memory = _memory != 0 ? _memory :
+				::std::pmr::get_default_resource();
+		char* data = static_cast<char*>(memory->allocate(capacity, 1));
+		::std::memcpy(data, pbase(), size);
+		if (_heap != 0) {
+			memory->deallocate(_heap, epptr() - pbase() + 1, 1);
+		}
+#else
+		char* data = static_cast<char*>(::std::realloc(_heap, capacity));
+		if (data == 0) {
+			return traits_type::eof();
+		}
+		if (_heap == 0) {
+			::std::memcpy(data, _inline, size);
+		}
+#endif
+		_heap = data;
+		setp(_heap, _heap + capacity - 1);
+		pbump(static_cast<int>(size));
+
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+		return ch;
+	}
+
+	_private::SiteRegistry& _private::Sites() {
+		static SiteRegistry* registry = new SiteRegistry();
+		return *registry;
+	}
+
+	::std::atomic<bool>& _private::SiteStatsFlag() {
+		static ::std::atomic<bool> enabled(false);
+		return enabled;
+	}
+
+	_private::SiteShard& _private::ThreadSites() {
+		struct Holder {
+			SiteShard* shard;
+			~Holder() { delete shard; }
+		};
+		static thread_local Holder holder = { 0 };
+		if (holder.shard == 0) {
+			holder.shard = new SiteShard;
+		}
+		return *holder.shard;
+	}
+
+	_private::SiteShard::SiteShard() {
+		for (::std::size_t i = 0; i != SIZE; ++i) {
+			slots[i].site.store(0, ::std::memory_order_relaxed);
+			slots[i].records.store(0, ::std::memory_order_relaxed);
+			slots[i].bytes.store(0, ::std::memory_order_relaxed);
+			slots[i].cycles.store(0, ::std::memory_order_relaxed);
+		}
+
+		SiteRegistry& registry = Sites();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		next = registry.head;
+		registry.head = this;
+	}
+
+	_private::SiteShard::~SiteShard() {
+		SiteRegistry& registry = Sites();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		for (::std::size_t i = 0; i != SIZE; ++i) {
+			const unsigned long long records =
+					slots[i].records.load(::std::memory_order_relaxed);
+			if (records != 0) {
+				SiteRegistry::Totals& totals = registry.retired[
+						slots[i].site.load(::std::memory_order_relaxed)];
+				totals.records += records;
+				totals.bytes += slots[i].bytes.load(::std::memory_order_relaxed);
+				totals.cycles += slots[i].cycles.load(::std::memory_order_relaxed);
+			}
+		}
+
+		SiteShard** link = &registry.head;
+		while (*link != this) {
+			link = &(*link)->next;
+		}
+		*link = next;
+	}
+
+	void _private::SiteShard::Count(const CallSite* site,
+			unsigned long long bytes, unsigned long long cycles) {
+		// probe a few slots, then give up into the overflow slot
+		const unsigned long long hash = static_cast<unsigned long long>(
+				reinterpret_cast< ::std::size_t>(site) >> 4) *
+				0x9E3779B97F4A7C15ULL;
+		SiteCounters* slot = &slots[SIZE - 1];
+		for (unsigned int probe = 0; probe != 8; ++probe) {
+			SiteCounters& candidate = slots[((hash >> 40) + probe) % (SIZE - 1)];
+			const CallSite* owner = candidate.site.load(
+					::std::memory_order_relaxed);
+			if (owner == site) {
+				slot = &candidate;
+				break;
+			} else if (owner == 0) {
+				candidate.site.store(site, ::std::memory_order_relaxed);
+				slot = &candidate;
+				break;
+			}
+		}
+
+		slot->records.store(slot->records.load(::std::memory_order_relaxed) + 1,
+				::std::memory_order_relaxed);
+		slot->bytes.store(slot->bytes.load(::std::memory_order_relaxed) + bytes,
+				::std::memory_order_relaxed);
+		slot->cycles.store(slot->cycles.load(::std::memory_order_relaxed) +
+				cycles, ::std::memory_order_relaxed);
+	}
+
+	::std::atomic<long long>& _private::SummaryPeriod() {
+		static ::std::atomic<long long> period(10000000000LL);
+		return period;
+	}
+
+	_private::SiteSummary::SiteSummary() : count(0), values(0), sum(0),
+			min(::std::numeric_limits<double>::infinity()),
+			max(-::std::numeric_limits<double>::infinity()), start(0),
+			logger(0), level(LEVEL_INFO), next(0) {}
+
+	void _private::SiteSummary::Add(double value) {
+		values.fetch_add(1, ::std::memory_order_relaxed);
+
+		double current = sum.load(::std::memory_order_relaxed);
+		while (!sum.compare_exchange_weak(current, current + value,
+				::std::memory_order_relaxed)) {}
+
+		current = min.load(::std::memory_order_relaxed);
+		while (value < current && !min.compare_exchange_weak(current, value,
+				::std::memory_order_relaxed)) {}
+
+		current = max.load(::std::memory_order_relaxed);
+		while (value > current && !max.compare_exchange_weak(current, value,
+				::std::memory_order_relaxed)) {}
+	}
+
+	int _private::CallSite::Register() {
+		SiteRegistry& registry = Sites();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		int current = state.load(::std::memory_order_relaxed);
+		if (current != UNREGISTERED) {
+			return current;
+		}
+
+		next = registry.sites;
+		registry.sites = this;
+
+		current = WRITE;
+		for (::std::size_t i = 0; i != registry.rules.size(); ++i) {
+			const SiteRegistry::Rule& rule = registry.rules[i];
+			if ((rule.line == 0 || rule.line == line) &&
+					MatchesFile(rule.file, file)) {
+				current = rule.summarize ? SUMMARIZE : WRITE;
+			}
+		}
+		if (current == SUMMARIZE && summary.load(::std::memory_order_relaxed) == 0) {
+			summary.store(registry.NewSummary(), ::std::memory_order_relaxed);
+		}
+		state.store(current, ::std::memory_order_release);
+		return current;
+	}
+
+	void _private::CallSite::Summarize(Logger& logger, LogLevel level) {
+		SiteSummary* aggregate = summary.load(::std::memory_order_acquire);
+		if (aggregate->logger.load(::std::memory_order_relaxed) != &logger) {
+			aggregate->logger.store(&logger, ::std::memory_order_relaxed);
+			aggregate->level.store(level, ::std::memory_order_relaxed);
+		}
+
+		aggregate->count.fetch_add(1, ::std::memory_order_relaxed);
+
+		// the first record after the interval writes its summary
+		const long long start = aggregate->start.load(::std::memory_order_relaxed);
+		if (start == 0 || CoarseNow() - start >=
+				SummaryPeriod().load(::std::memory_order_relaxed)) {
+			Emit(false);
+		}
+	}
+
+	void _private::CallSite::Summarize(Logger& logger, LogLevel level,
+			double value) {
+		summary.load(::std::memory_order_acquire)->Add(value);
+		Summarize(logger, level);
+	}
+
+	void _private::CallSite::Emit(bool force) {
+		ReadSection section;
+		SiteSummary* aggregate = summary.load(::std::memory_order_acquire);
+		if (aggregate == 0) {
+			return;
+		}
+
+		const long long now = CoarseNow();
+		long long start = aggregate->start.load(::std::memory_order_relaxed);
+		if (start == 0 && !force) {
+			aggregate->start.compare_exchange_strong(start, now,
+					::std::memory_order_relaxed);
+			return;
+		}
+		if (!force && now - start < SummaryPeriod().load(::std::memory_order_relaxed)) {
+			return;
+		}
+		if (!aggregate->start.compare_exchange_strong(start, now,
+				::std::memory_order_relaxed)) {
+			// another thread is writing this interval's summary
+			return;
+		}
+
+		const unsigned long long count = aggregate->count.exchange(0,
+				::std::memory_order_relaxed);
+		const unsigned long long values = aggregate->values.exchange(0,
+				::std::memory_order_relaxed);
+		const double sum = aggregate->sum.exchange(0, ::std::memory_order_relaxed);
+		const double min = aggregate->min.exchange(
+				::std::numeric_limits<double>::infinity(),
+				::std::memory_order_relaxed);
+		const double max = aggregate->max.exchange(
+				-::std::numeric_limits<double>::infinity(),
+				::std::memory_order_relaxed);
+		Logger* logger = aggregate->logger.load(::std::memory_order_relaxed);
+		if (count == 0 || logger == 0) {
+			return;
+		}
+
+		LogSink sink(logger->Log(static_cast<LogLevel>(aggregate->level.load(
+				::std::memory_order_relaxed)), file, line, func));
+		sink.Stream() << "[summary] " << count << " records in "
+				<< (start != 0 ? (now - start) / 1000000 : 0) << "ms";
+		if (values != 0) {
+			sink.Stream() << ", value min " << min << " max " << max << " mean "
+					<< sum / values;
+		}
+	}
+
+	void Summarize(const char* file, unsigned int line, bool summarize) {
+		_private::SiteRegistry& registry = _private::Sites();
+		::std::vector<_private::CallSite*> flush;
+		{
+			::std::lock_guard< ::std::mutex> guard(registry.lock);
+			const _private::SiteRegistry::Rule rule = { file, line, summarize };
+			registry.rules.push_back(rule);
+
+			for (_private::CallSite* site = registry.sites; site != 0;
+					site = site->next) {
+				if ((line != 0 && site->line != line) ||
+						!_private::MatchesFile(rule.file, site->file)) {
+					continue;
+				}
+				if (summarize) {
+					if (site->summary.load(::std::memory_order_relaxed) == 0) {
+						site->summary.store(registry.NewSummary(),
+								::std::memory_order_release);
+					}
+					site->state.store(_private::CallSite::SUMMARIZE,
+							::std::memory_order_release);
+				} else {
+					site->state.store(_private::CallSite::WRITE,
+							::std::memory_order_release);
+					flush.push_back(site);
+				}
+			}
+		}
+
+		for (::std::size_t i = 0; i != flush.size(); ++i) {
+			flush[i]->Emit(true);
+		}
+	}
+
+	void SummaryInterval(unsigned long interval) {
+		_private::SummaryPeriod().store(interval * 1000000LL,
+				::std::memory_order_relaxed);
+	}
+
+	void FlushSummaries() {
+		_private::SiteRegistry& registry = _private::Sites();
+		::std::vector<_private::CallSite*> sites;
+		{
+			::std::lock_guard< ::std::mutex> guard(registry.lock);
+			for (_private::CallSite* site = registry.sites; site != 0;
+					site = site->next) {
+				sites.push_back(site);
+			}
+		}
+
+		for (::std::size_t i = 0; i != sites.size(); ++i) {
+			sites[i]->Emit(true);
+		}
+	}
+
+	void SiteStats(bool enable) {
+		_private::SiteStatsFlag().store(enable, ::std::memory_order_relaxed);
+	}
+
+	void SiteReport(::std::ostream& os, SiteSort sort, ::std::size_t limit) {
+		typedef _private::SiteRegistry::Totals Totals;
+		typedef ::std::pair<const _private::CallSite*, Totals> Entry;
+
+		_private::SiteRegistry& registry = _private::Sites();
+		::std::map<const _private::CallSite*, Totals> totals;
+		{
+			::std::lock_guard< ::std::mutex> guard(registry.lock);
+			totals = registry.retired;
+			for (_private::SiteShard* shard = registry.head; shard != 0;
+					shard = shard->next) {
+				for (::std::size_t i = 0; i != _private::SiteShard::SIZE; ++i) {
+					const _private::SiteCounters& slot = shard->slots[i];
+					const unsigned long long records =
+							slot.records.load(::std::memory_order_relaxed);
+					if (records != 0) {
+						Totals& site = totals[i == _private::SiteShard::SIZE - 1 ?
+								0 : slot.site.load(::std::memory_order_relaxed)];
+						site.records += records;
+						site.bytes += slot.bytes.load(::std::memory_order_relaxed);
+						site.cycles += slot.cycles.load(::std::memory_order_relaxed);
+					}
+				}
+			}
+		}
+
+		::std::vector<Entry> entries(totals.begin(), totals.end());
+		::std::stable_sort(entries.begin(), entries.end(),
+				[sort](const Entry& lhs, const Entry& rhs) {
+			return sort == SORT_RECORDS ?
+					lhs.second.records > rhs.second.records :
+					sort == SORT_CYCLES ? lhs.second.cycles > rhs.second.cycles :
+					lhs.second.bytes > rhs.second.bytes;
+		});
+
+		os << ::std::setw(12) << "records" << ' ' << ::std::setw(14) << "bytes"
+				<< ' ' << ::std::setw(16) << "cycles" << "  site\n";
+		for (::std::size_t i = 0; i != entries.size() &&
+				(limit == 0 || i != limit); ++i) {
+			const _private::CallSite* site = entries[i].first;
+			os << ::std::setw(12) << entries[i].second.records << ' '
+					<< ::std::setw(14) << entries[i].second.bytes << ' '
+					<< ::std::setw(16) << entries[i].second.cycles << "  ";
+			if (site != 0) {
+				os << site->file << ':' << site->line << ' ' << site->func;
+			} else {
+				os << "(other)";
+			}
+			os << '\n';
+		}
+	}
+
+	void ResetSiteStats() {
+		_private::SiteRegistry& registry = _private::Sites();
+		::std::lock_guard< ::std::mutex> guard(registry.lock);
+		registry.retired.clear();
+		for (_private::SiteShard* shard = registry.head; shard != 0;
+				shard = shard->next) {
+			for (::std::size_t i = 0; i != _private::SiteShard::SIZE; ++i) {
+				shard->slots[i].records.store(0, ::std::memory_order_relaxed);
+				shard->slots[i].bytes.store(0, ::std::memory_order_relaxed);
+				shard->slots[i].cycles.store(0, ::std::memory_order_relaxed);
+			}
+		}
+	}
+
+	void _private::WriteStack(::std::ostream& os, void* const* frames,
+			int depth) {
+#if EASYLOGGER_HAVE_BACKTRACE
+		static ::std::mutex lock;
+		static ::std::map<void*, ::std::string> cache;
+
+		::std::lock_guard< ::std::mutex> guard(lock);
+		for (int i = 0; i != depth; ++i) {
+			::std::map<void*, ::std::string>::iterator frame =
+					cache.find(frames[i]);
+			if (frame == cache.end()) {
+				::std::ostringstream name;
+				Dl_info info;
+				if (::dladdr(frames[i], &info) != 0 && info.dli_fname != 0) {
+					if (info.dli_sname != 0) {
+						int status = -1;
+						char* demangled = abi::__cxa_demangle(info.dli_sname,
+								0, 0, &status);
+						name << (status == 0 ? demangled : info.dli_sname)
+								<< "+0x" << ::std::hex
+								<< (static_cast<char*>(frames[i]) -
+								static_cast<char*>(info.dli_saddr)) << ' ';
+						::std::free(demangled);
+					}
+					name << '(' << info.dli_fname << "+0x" << ::std::hex
+							<< (static_cast<char*>(frames[i]) -
+							static_cast<char*>(info.dli_fbase)) << ')';
+				} else {
+					name << frames[i];
+				}
+				frame = cache.insert(::std::make_pair(frames[i],
+						name.str())).first;
+			}
+			os << "\n\t#" << i << ' ' << frame->second;
+		}
+#else
+		(void)os;
+		(void)frames;
+		(void)depth;
+#endif
 	}
 
 } // namespace easylogger
+
+#endif
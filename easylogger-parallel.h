@@ -0,0 +1,361 @@
+//! \file easylogger-parallel.h
+//!
+//! Parallel formatting backend for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_PARALLEL_H)
+#define EASYLOGGER_PARALLEL_H
+
+#include "easylogger-async.h"
+#include "easylogger-private.h"
+
+namespace easylogger {
+
+	//! Sink formatting records on worker threads
+	//!
+	//! Write() copies the unformatted record into a bounded lock-free
+	//! queue and returns; the Logger does not format it.  A pool of
+	//! worker threads takes records from the queue in any order and
+	//! formats them with FormatRecord(), using the format string of the
+	//! Logger the sink is attached to.  Each output sink added with Add()
+	//! has a thread of its own, which writes formatted records to it in
+	//! the order they were queued.
+	//!
+	//! Output sinks advance independently: a slow sink does not hold
+	//! back a fast one until it falls a whole queue behind, at which
+	//! point Write() waits for space.  No record is dropped.  The wake
+	//! strategy applies to the workers and output threads alike; see
+	//! AsyncSink.
+	//!
+	//! Records reach output sinks with a stand-in Logger carrying the
+	//! original's name, as with AsyncSink.  Records that arrive already
+	//! formatted, through a sink in front of this one, are not
+	//! formatted again.
+	//!
+	//! The sink may be shared by Loggers writing from several threads.
+	class ParallelSink : public Sink {
+	public:
+		//! Construct a new sink and start its workers
+		//!
+		//! \param workers Number of formatting threads; at least 1.
+		//! \param strategy How workers and output threads wait.
+		//! \param interval Spin time for WAKE_SPIN_SLEEP, or drain
+		//! period for WAKE_TIMED.
+		//! \param capacity Records the queue holds; rounded up to a power
+		//! of two, at least 4.
+		inline explicit ParallelSink(unsigned int workers = 2,
+				WakeStrategy strategy = WAKE_SPIN_SLEEP,
+				::std::chrono::microseconds interval =
+						::std::chrono::microseconds(50),
+				::std::size_t capacity = 8192);
+
+		//! Write all queued records and stop all threads
+		inline ~ParallelSink();
+
+		//! Add an output sink and start its thread
+		//!
+		//! All outputs must be added before the first record is
+		//! written.  The output must outlive this sink.
+		//!
+		//! \param sink Sink to write formatted records to.
+		inline void Add(Sink& sink);
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		//! Wait for queued records to be written, then flush the outputs
+		inline void Flush();
+
+		bool Formats() const { return true; }
+
+	private:
+		ParallelSink(const ParallelSink&);
+		ParallelSink& operator=(const ParallelSink&);
+
+		//! A queued record
+		struct Slot {
+			//! pos when free, pos + 1 when holding the record queued
+			//! at pos, and pos + 2 once that record is formatted
+			::std::atomic< ::std::size_t> sequence;
+			//! Outputs that have yet to write the record
+			::std::atomic<unsigned int> pending;
+			LogLevel level;
+			//! Copy of the Logger name, which may be borrowed
+			::std::string name;
+			const char* file;
+			unsigned int line;
+			const char* func;
+			const char* format;
+			::std::string message;
+			::std::vector<void*> frames;
+			//! Formatted text; set by Write() if already formatted
+			::std::string text;
+			bool formatted;
+		};
+
+		//! An output sink and its thread
+		struct Output {
+			Sink* sink;
+			_private::Doorbell doorbell;
+			//! Queue position up to which the sink was last flushed
+			::std::size_t flushed;
+			::std::thread thread;
+		};
+
+		//! Check if the next record to format has been queued
+		bool Queued() const {
+			const ::std::size_t pos = _format_pos.load(::std::memory_order_relaxed);
+			return _slots[pos & _mask].sequence.load(
+					::std::memory_order_acquire) == pos + 1;
+		}
+
+		//! Build the record handed to outputs
+		static LogRecord Record(const Slot& slot, const Logger& standin) {
+			const LogRecord record = { slot.level, &standin, slot.file,
+					slot.line, slot.func, slot.message.c_str(),
+					slot.frames.empty() ? 0 : &slot.frames[0],
+					static_cast<int>(slot.frames.size()), slot.format };
+			return record;
+		}
+
+		//! Worker thread body
+		inline void Work();
+
+		//! Output thread body
+		inline void Commit(Output* output);
+
+		//! Flush an output if a flush it has reached is pending
+		inline void CheckFlush(Output* output, ::std::size_t pos);
+
+		//! Wake every thread of the sink
+		inline void WakeAll();
+
+		WakeStrategy _strategy;
+
+		::std::chrono::microseconds _interval;
+
+		::std::vector<Slot> _slots;
+
+		::std::size_t _mask;
+
+		//! Next position to queue at
+		::std::atomic< ::std::size_t> _tail;
+
+		//! Next position to format
+		::std::atomic< ::std::size_t> _format_pos;
+
+		_private::Doorbell _doorbell;
+
+		::std::atomic<bool> _running;
+
+		::std::vector< ::std::thread> _workers;
+
+		::std::vector<Output*> _outputs;
+
+		//! Queue position Flush() waits for
+		::std::atomic< ::std::size_t> _flush_request;
+
+		::std::mutex _flush_lock;
+
+		::std::condition_variable _flushed;
+	};
+
+	ParallelSink::ParallelSink(unsigned int workers, WakeStrategy strategy,
+			::std::chrono::microseconds interval, ::std::size_t capacity) :
+			_strategy(strategy), _interval(interval),
+			_slots(_private::QueueCapacity(capacity, 4)),
+			_mask(_slots.size() - 1), _tail(0), _format_pos(0), _running(true),
+			_flush_request(0) {
+		// a slot holding the record queued at pos reads pos + 1 or
+		// pos + 2, which must not equal pos + capacity, when it is free
+		for (::std::size_t i = 0; i != _slots.size(); ++i) {
+			_slots[i].sequence.store(i, ::std::memory_order_relaxed);
+		}
+		for (unsigned int i = 0; i < (workers != 0 ? workers : 1); ++i) {
+			_workers.push_back(::std::thread(&ParallelSink::Work, this));
+		}
+	}
+
+	ParallelSink::~ParallelSink() {
+		_running.store(false, ::std::memory_order_release);
+		WakeAll();
+		for (::std::size_t i = 0; i != _workers.size(); ++i) {
+			_workers[i].join();
+		}
+		for (::std::size_t i = 0; i != _outputs.size(); ++i) {
+			_outputs[i]->thread.join();
+			delete _outputs[i];
+		}
+	}
+
+	void ParallelSink::Add(Sink& sink) {
+		Output* output = new Output;
+		output->sink = &sink;
+		output->flushed = 0;
+		_outputs.push_back(output);
+		output->thread = ::std::thread(&ParallelSink::Commit, this, output);
+	}
+
+	bool ParallelSink::Write(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		::std::size_t pos = _tail.load(::std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &_slots[pos & _mask];
+			const ::std::size_t sequence = slot->sequence.load(
+					::std::memory_order_acquire);
+			if (sequence == pos) {
+				if (_tail.compare_exchange_weak(pos, pos + 1,
+						::std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (sequence < pos) {
+				// full; the slowest output is a whole queue behind
+				WakeAll();
+				::std::this_thread::yield();
+				pos = _tail.load(::std::memory_order_relaxed);
+			} else {
+				pos = _tail.load(::std::memory_order_relaxed);
+			}
+		}
+
+		slot->level = record.level;
+		slot->name.assign(record.logger->Name());
+		slot->file = record.file;
+		slot->line = record.line;
+		slot->func = record.func;
+		slot->format = record.format;
+		slot->message.assign(record.message);
+		slot->frames.assign(record.frames, record.frames + record.depth);
+		slot->formatted = text != 0;
+		if (text != 0) {
+			slot->text.assign(text, length);
+		}
+		slot->sequence.store(pos + 1, ::std::memory_order_release);
+
+		_doorbell.Ring();
+		return true;
+	}
+
+	void ParallelSink::Flush() {
+		const ::std::size_t target = _tail.load(::std::memory_order_acquire);
+		::std::unique_lock< ::std::mutex> guard(_flush_lock);
+		if (target > _flush_request.load(::std::memory_order_relaxed)) {
+			_flush_request.store(target, ::std::memory_order_release);
+		}
+		for (;;) {
+			bool done = true;
+			for (::std::size_t i = 0; i != _outputs.size(); ++i) {
+				done = done && _outputs[i]->flushed >= target;
+			}
+			if (done) {
+				break;
+			}
+			WakeAll();
+			_flushed.wait_for(guard, ::std::chrono::milliseconds(1));
+		}
+	}
+
+	void ParallelSink::WakeAll() {
+		_doorbell.Wake();
+		for (::std::size_t i = 0; i != _outputs.size(); ++i) {
+			_outputs[i]->doorbell.Wake();
+		}
+	}
+
+	void ParallelSink::Work() {
+		_private::MessageBuf text;
+		for (;;) {
+			::std::size_t pos = _format_pos.load(::std::memory_order_relaxed);
+			Slot& slot = _slots[pos & _mask];
+			if (slot.sequence.load(::std::memory_order_acquire) == pos + 1) {
+				if (!_format_pos.compare_exchange_weak(pos, pos + 1,
+						::std::memory_order_relaxed)) {
+					continue;
+				}
+
+				if (!slot.formatted) {
+					text.Clear();
+					::std::ostream os(&text);
+					const Logger standin(slot.name.c_str());
+					const LogRecord record = Record(slot, standin);
+					FormatRecord(os, record);
+					_private::WriteStack(os, record.frames, record.depth);
+					os << '\n';
+					slot.text.assign(text.Text(), text.Size());
+				}
+
+				const unsigned int outputs =
+						static_cast<unsigned int>(_outputs.size());
+				slot.pending.store(outputs, ::std::memory_order_relaxed);
+				slot.sequence.store(outputs != 0 ? pos + 2 : pos + _slots.size(),
+						::std::memory_order_release);
+				for (::std::size_t i = 0; i != _outputs.size(); ++i) {
+					_outputs[i]->doorbell.Ring();
+				}
+				continue;
+			}
+
+			if (!_running.load(::std::memory_order_acquire) &&
+					pos == _tail.load(::std::memory_order_acquire)) {
+				break;
+			}
+			_doorbell.Wait(_strategy, _interval, [this] {
+				return Queued() || !_running.load(::std::memory_order_relaxed);
+			});
+		}
+	}
+
+	void ParallelSink::Commit(Output* output) {
+		::std::size_t pos = 0;
+		for (;;) {
+			Slot& slot = _slots[pos & _mask];
+			if (slot.sequence.load(::std::memory_order_acquire) == pos + 2) {
+				const Logger standin(slot.name.c_str());
+				output->sink->Write(Record(slot, standin), slot.text.data(),
+						slot.text.size());
+				// the last output to write the record frees the slot
+				if (slot.pending.fetch_sub(1, ::std::memory_order_acq_rel) == 1) {
+					slot.sequence.store(pos + _slots.size(),
+							::std::memory_order_release);
+				}
+				++pos;
+				CheckFlush(output, pos);
+				continue;
+			}
+
+			CheckFlush(output, pos);
+			if (!_running.load(::std::memory_order_acquire) &&
+					pos == _tail.load(::std::memory_order_acquire)) {
+				break;
+			}
+			output->doorbell.Wait(_strategy, _interval, [this, &slot, pos] {
+				return slot.sequence.load(::std::memory_order_acquire) == pos + 2 ||
+						!_running.load(::std::memory_order_relaxed);
+			});
+		}
+		output->sink->Flush();
+	}
+
+	void ParallelSink::CheckFlush(Output* output, ::std::size_t pos) {
+		const ::std::size_t request = _flush_request.load(
+				::std::memory_order_acquire);
+		// only this output's thread changes its flushed position
+		if (request == 0 || pos < request || output->flushed >= request) {
+			return;
+		}
+		::std::lock_guard< ::std::mutex> guard(_flush_lock);
+		if (output->flushed < request) {
+			output->sink->Flush();
+			output->flushed = pos;
+			_flushed.notify_all();
+		}
+	}
+
+} // namespace easylogger
+
+#endif
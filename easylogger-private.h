@@ -0,0 +1,161 @@
+//! \file easylogger-private.h
+//!
+//! Internal types of Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Types shared by the implementation and the optional modules, which
+//! easylogger.h only declares so that programs using the compiled
+//! library do not include <ostream>, <mutex> or <vector>.
+
+// included first: in header-only builds it includes the implementation,
+// which includes this header again to define the types below
+#include "easylogger.h"
+
+#if !defined(EASYLOGGER_PRIVATE_H)
+#define EASYLOGGER_PRIVATE_H
+
+#include <ostream>
+#include <mutex>
+#include <vector>
+
+#if EASYLOGGER_HAVE_PMR
+# include <memory_resource>
+#endif
+
+namespace easylogger {
+
+	namespace _private {
+
+		//! Registry of the readers of all live threads
+		//!
+		//! \internal
+		struct ReaderRegistry {
+			//! Lock held while walking or modifying the registry
+			::std::mutex lock;
+
+			//! First registered reader
+			Reader* head;
+		};
+
+		//! Registry of the scope stacks of all live threads
+		//!
+		//! \internal
+		struct ScopeRegistry {
+			//! Lock held while walking or modifying the registry
+			::std::mutex lock;
+
+			//! First registered stack
+			ScopeStack* head;
+		};
+
+		//! Stream buffer collecting the text of a single message
+		//!
+		//! Messages of up to INLINE_SIZE bytes are kept in the buffer
+		//! itself; longer ones move to the heap, or to the memory
+		//! resource of the Logger when there is one.
+		//!
+		//! \internal
+		class MessageBuf : public ::std::streambuf {
+		public:
+			//! Capacity of the inline buffer, including the terminator
+			enum { INLINE_SIZE = 256 };
+
+			MessageBuf() : _heap(0) {
+				setp(_inline, _inline + INLINE_SIZE - 1);
+			}
+
+			EASYLOGGER_INLINE ~MessageBuf();
+
+			//! Get the text written so far
+			//!
+			//! \returns NUL-terminated text
+			const char* Text() {
+				*pptr() = 0;
+				return pbase();
+			}
+
+			//! Get the length of the text written so far
+			//!
+			//! \returns Length in bytes
+			::std::size_t Size() const { return pptr() - pbase(); }
+
+			//! Discard the text written so far, keeping the buffer
+			void Clear() { setp(pbase(), epptr()); }
+
+#if EASYLOGGER_HAVE_PMR
+			//! Get the resource long messages are moved to
+			//!
+			//! \returns Memory resource; NULL for the default resource
+			::std::pmr::memory_resource* Memory() const { return _memory; }
+
+			//! Set the resource long messages are moved to
+			//!
+			//! Must be called before anything is written.
+			//!
+			//! \param memory Memory resource.
+			void Memory(::std::pmr::memory_resource* memory) {
+				_memory = memory;
+			}
+#endif
+
+		protected:
+			EASYLOGGER_INLINE int_type overflow(int_type ch);
+
+		private:
+			MessageBuf(const MessageBuf&);
+			MessageBuf& operator=(const MessageBuf&);
+
+			char* _heap;
+
+#if EASYLOGGER_HAVE_PMR
+			//! Resource holding _heap; NULL for the default resource
+			::std::pmr::memory_resource* _memory = 0;
+#endif
+
+			char _inline[INLINE_SIZE];
+		};
+
+		//! Text of a message and the stream writing it
+		//!
+		//! \internal
+		struct MessageText {
+			MessageText() : os(&buf) {}
+
+			MessageBuf buf;
+
+			::std::ostream os;
+		};
+
+		//! Messages of a Batch
+		//!
+		//! With a memory resource, the messages, the offsets and the
+		//! BatchText itself are allocated from it.
+		//!
+		//! \internal
+		struct BatchText : MessageText {
+#if EASYLOGGER_HAVE_PMR
+			//! Create an empty batch allocating from a resource
+			//!
+			//! \param memory Memory resource.
+			explicit BatchText(::std::pmr::memory_resource& memory) :
+					starts(&memory) {
+				buf.Memory(&memory);
+			}
+
+			//! Offset of each record's message; messages end with a NUL
+			::std::pmr::vector< ::std::size_t> starts;
+#else
+			//! Offset of each record's message; messages end with a NUL
+			::std::vector< ::std::size_t> starts;
+#endif
+		};
+
+	} // namespace _private
+
+} // namespace easylogger
+
+#endif
@@ -0,0 +1,151 @@
+//! \file easylogger-profile.h
+//!
+//! Scope sampling profiler for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_PROFILE_H)
+#define EASYLOGGER_PROFILE_H
+
+#include "easylogger.h"
+#include "easylogger-private.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <thread>
+
+namespace easylogger {
+
+	//! Sampling profiler over TRACE scopes
+	//!
+	//! Every TRACE scope pushes its name onto a stack owned by the
+	//! current thread, whether or not the trace itself is logged.  A
+	//! ScopeProfiler runs a thread that periodically snapshots the
+	//! stacks of all threads and counts each distinct stack.  The
+	//! counts are written in the folded format understood by
+	//! flamegraph.pl and speedscope, one line per stack:
+	//!
+	//!     main;handle_request;parse 42
+	//!
+	//! Threads with no active scope are not sampled.
+	class ScopeProfiler {
+	public:
+		ScopeProfiler() : _running(false) {}
+
+		~ScopeProfiler() { Stop(); }
+
+		//! Start sampling
+		//!
+		//! \param interval Time between samples.
+		inline void Start(::std::chrono::microseconds interval =
+				::std::chrono::milliseconds(10));
+
+		//! Stop sampling
+		inline void Stop();
+
+		//! Take a single sample of all threads now
+		inline void Sample();
+
+		//! Write the collected samples in folded-stack format
+		//!
+		//! \param os Stream to write to.
+		inline void Dump(::std::ostream& os);
+
+		//! Discard all collected samples
+		inline void Clear();
+
+	private:
+		ScopeProfiler(const ScopeProfiler&);
+		ScopeProfiler& operator=(const ScopeProfiler&);
+
+		//! Sampler thread body
+		inline void Run(::std::chrono::microseconds interval);
+
+		::std::mutex _lock;
+
+		::std::condition_variable _wake;
+
+		bool _running;
+
+		::std::thread _thread;
+
+		::std::map< ::std::string, unsigned long long> _counts;
+	};
+
+	void ScopeProfiler::Start(::std::chrono::microseconds interval) {
+		Stop();
+		_running = true;
+		_thread = ::std::thread(&ScopeProfiler::Run, this, interval);
+	}
+
+	void ScopeProfiler::Stop() {
+		{
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			_running = false;
+		}
+		_wake.notify_all();
+		if (_thread.joinable()) {
+			_thread.join();
+		}
+	}
+
+	void ScopeProfiler::Run(::std::chrono::microseconds interval) {
+		::std::unique_lock< ::std::mutex> guard(_lock);
+		while (_running) {
+			guard.unlock();
+			Sample();
+			guard.lock();
+			_wake.wait_for(guard, interval);
+		}
+	}
+
+	void ScopeProfiler::Sample() {
+		_private::ScopeRegistry& registry = _private::Scopes();
+		::std::string folded;
+
+		::std::lock_guard< ::std::mutex> registry_guard(registry.lock);
+		for (_private::ScopeStack* stack = registry.head; stack != 0;
+				stack = stack->_next) {
+			unsigned int depth = stack->_depth.load(::std::memory_order_acquire);
+			if (depth == 0) {
+				continue;
+			}
+			if (depth > _private::ScopeStack::MAX_DEPTH) {
+				depth = _private::ScopeStack::MAX_DEPTH;
+			}
+
+			folded.clear();
+			for (unsigned int i = 0; i != depth; ++i) {
+				const char* name = stack->_names[i].load(
+						::std::memory_order_relaxed);
+				if (i != 0) {
+					folded += ';';
+				}
+				folded += name != 0 ? name : "?";
+			}
+
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			++_counts[folded];
+		}
+	}
+
+	void ScopeProfiler::Dump(::std::ostream& os) {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		for (::std::map< ::std::string, unsigned long long>::const_iterator
+				i = _counts.begin(); i != _counts.end(); ++i) {
+			os << i->first << ' ' << i->second << '\n';
+		}
+	}
+
+	void ScopeProfiler::Clear() {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		_counts.clear();
+	}
+
+} // namespace easylogger
+
+#endif
@@ -0,0 +1,312 @@
+//! \file easylogger-sketch.h
+//!
+//! Message template heavy-hitter tracking for Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+
+#if !defined(EASYLOGGER_SKETCH_H)
+#define EASYLOGGER_SKETCH_H
+
+#include "easylogger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+
+namespace easylogger {
+
+	//! Sink counting the most frequent message templates
+	//!
+	//! Each record's message is reduced to a template by replacing
+	//! numbers and hexadecimal identifiers with '#', so that
+	//! "user 42 logged in from 10.0.0.7" and "user 7 logged in from
+	//! 10.0.0.9" count as the same template.  Template frequencies
+	//! are estimated with a count-min sketch, and the heaviest
+	//! templates are kept in a fixed-size top-K table, so memory use
+	//! is constant no matter how many distinct messages are seen.
+	//!
+	//! Counts cover one interval at a time.  When an interval ends,
+	//! when the sink is flushed and when it is destroyed, the summary
+	//! of the records counted so far is written to the report stream,
+	//! if one is set, and counting starts afresh.
+	//!
+	//! The sketch writes nothing else.  It can be attached with
+	//! Logger::Output() next to the Logger's normal stream, or wrap
+	//! another sink, such as a FileSink, and pass every record on to it.
+	class TemplateSketch : public Sink {
+	public:
+		//! Number of templates tracked per interval
+		enum { TOP_K = 32 };
+
+		//! Maximum length of a template, in bytes
+		enum { MAX_TEMPLATE = 160 };
+
+		//! Construct a new sketch
+		//!
+		//! \param interval Length of each counting interval.
+		//! \param next Sink every record is passed on to, or NULL.
+		inline explicit TemplateSketch(::std::chrono::seconds interval =
+				::std::chrono::seconds(60), Sink* next = 0);
+
+		//! Write the summary of the last interval
+		inline ~TemplateSketch();
+
+		//! Set the stream receiving a summary after each interval
+		//!
+		//! The stream must outlive the sketch.
+		//!
+		//! \param report Stream to write summaries to, or NULL.
+		void Report(::std::ostream* report) {
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			_report = report;
+		}
+
+		//! Write the summary of the current interval so far
+		//!
+		//! \param os Stream to write to.
+		inline void Summary(::std::ostream& os);
+
+		//! Reduce a message to its template
+		//!
+		//! \param message Message to reduce.
+		//! \param out Buffer of at least MAX_TEMPLATE + 1 bytes.
+		//! \returns Length of template written to out.
+		static inline ::std::size_t Fingerprint(const char* message,
+				char* out);
+
+		inline bool Write(const LogRecord& record, const char* text,
+				::std::size_t length);
+
+		inline bool WriteBatch(const LogRecord* records, const char* text,
+				const ::std::size_t* lengths, ::std::size_t count);
+
+		//! Write the summary so far and start a new interval
+		inline void Flush();
+
+		//! Only the unformatted message is counted, so records need not
+		//! be formatted unless the next sink needs them
+		bool Formats() const { return _next == 0 || _next->Formats(); }
+
+	private:
+		TemplateSketch(const TemplateSketch&);
+		TemplateSketch& operator=(const TemplateSketch&);
+
+		//! Count-min sketch dimensions
+		enum { DEPTH = 4, WIDTH = 2048 };
+
+		//! A tracked heavy-hitter template
+		struct Entry {
+			unsigned long long hash;
+			unsigned long long count;
+			char text[MAX_TEMPLATE + 1];
+		};
+
+		//! Count a record's template
+		inline void Count(const LogRecord& record);
+
+		//! Write a summary; caller holds the lock
+		inline void WriteSummary(::std::ostream& os);
+
+		//! Write a summary to the report stream and start a new
+		//! interval; caller holds the lock
+		inline void EndInterval();
+
+		//! Start a new interval; caller holds the lock
+		inline void Reset();
+
+		::std::mutex _lock;
+
+		::std::chrono::seconds _interval;
+
+		::std::chrono::steady_clock::time_point _start;
+
+		::std::ostream* _report;
+
+		Sink* _next;
+
+		unsigned long long _records;
+
+		unsigned int _counts[DEPTH][WIDTH];
+
+		::std::size_t _size;
+
+		Entry _top[TOP_K];
+	};
+
+	TemplateSketch::TemplateSketch(::std::chrono::seconds interval,
+			Sink* next) : _interval(interval), _report(0), _next(next) {
+		Reset();
+	}
+
+	TemplateSketch::~TemplateSketch() {
+		EndInterval();
+	}
+
+	::std::size_t TemplateSketch::Fingerprint(const char* message,
+			char* out) {
+		::std::size_t length = 0;
+		const char* cptr = message;
+		while (*cptr != 0 && length != MAX_TEMPLATE) {
+			const char* start = cptr;
+			// a token of digits and hex letters is an identifier if it
+			// has a digit and either starts with one or is long
+			bool digit = false;
+			if (cptr[0] == '0' && (cptr[1] == 'x' || cptr[1] == 'X')) {
+				cptr += 2;
+			}
+			while ((*cptr >= '0' && *cptr <= '9') ||
+					(*cptr >= 'a' && *cptr <= 'f') ||
+					(*cptr >= 'A' && *cptr <= 'F')) {
+				digit = digit || (*cptr >= '0' && *cptr <= '9');
+				++cptr;
+			}
+			if (digit && ((*start >= '0' && *start <= '9') ||
+					cptr - start >= 8)) {
+				if (length == 0 || out[length - 1] != '#') {
+					out[length++] = '#';
+				}
+				continue;
+			}
+
+			// copy the rest of a word verbatim, up to the next boundary
+			cptr = start;
+			do {
+				out[length++] = *cptr++;
+			} while (*cptr != 0 && length != MAX_TEMPLATE &&
+					((*start >= 'a' && *start <= 'z') ||
+					(*start >= 'A' && *start <= 'Z') || *start == '_') &&
+					((*cptr >= 'a' && *cptr <= 'z') ||
+					(*cptr >= 'A' && *cptr <= 'Z') || *cptr == '_' ||
+					(*cptr >= '0' && *cptr <= '9')));
+		}
+		out[length] = 0;
+		return length;
+	}
+
+	bool TemplateSketch::Write(const LogRecord& record, const char* text,
+			::std::size_t length) {
+		Count(record);
+		return _next == 0 || _next->Write(record, text, length);
+	}
+
+	bool TemplateSketch::WriteBatch(const LogRecord* records,
+			const char* text, const ::std::size_t* lengths,
+			::std::size_t count) {
+		for (::std::size_t i = 0; i != count; ++i) {
+			Count(records[i]);
+		}
+		return _next == 0 || _next->WriteBatch(records, text, lengths, count);
+	}
+
+	void TemplateSketch::Flush() {
+		{
+			::std::lock_guard< ::std::mutex> guard(_lock);
+			EndInterval();
+		}
+		if (_next != 0) {
+			_next->Flush();
+		}
+	}
+
+	void TemplateSketch::Count(const LogRecord& record) {
+		char text[MAX_TEMPLATE + 1];
+		const ::std::size_t length = Fingerprint(record.message, text);
+
+		// FNV-1a; the two halves seed the sketch rows
+		unsigned long long hash = 14695981039346656037ULL;
+		for (::std::size_t i = 0; i != length; ++i) {
+			hash = (hash ^ static_cast<unsigned char>(text[i])) *
+					1099511628211ULL;
+		}
+
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		const ::std::chrono::steady_clock::time_point now =
+				::std::chrono::steady_clock::now();
+		if (now - _start >= _interval) {
+			EndInterval();
+			_start = now;
+		}
+		++_records;
+
+		// conservative update: only raise the smallest counters
+		unsigned int* cells[DEPTH];
+		unsigned int estimate = ~0U;
+		for (unsigned int row = 0; row != DEPTH; ++row) {
+			const unsigned long long h = (hash >> 32) + row * (hash & 0xffffffffULL);
+			cells[row] = &_counts[row][h % WIDTH];
+			if (*cells[row] < estimate) {
+				estimate = *cells[row];
+			}
+		}
+		++estimate;
+		for (unsigned int row = 0; row != DEPTH; ++row) {
+			if (*cells[row] < estimate) {
+				*cells[row] = estimate;
+			}
+		}
+
+		// keep the template in the top-K if it is heavy enough
+		::std::size_t lightest = 0;
+		for (::std::size_t i = 0; i != _size; ++i) {
+			if (_top[i].hash == hash) {
+				_top[i].count = estimate;
+				return;
+			}
+			if (_top[i].count < _top[lightest].count) {
+				lightest = i;
+			}
+		}
+		if (_size < TOP_K) {
+			lightest = _size++;
+		} else if (_top[lightest].count >= estimate) {
+			return;
+		}
+		_top[lightest].hash = hash;
+		_top[lightest].count = estimate;
+		::std::memcpy(_top[lightest].text, text, length + 1);
+	}
+
+	void TemplateSketch::Summary(::std::ostream& os) {
+		::std::lock_guard< ::std::mutex> guard(_lock);
+		WriteSummary(os);
+	}
+
+	void TemplateSketch::WriteSummary(::std::ostream& os) {
+		const Entry* order[TOP_K];
+		for (::std::size_t i = 0; i != _size; ++i) {
+			order[i] = &_top[i];
+		}
+		::std::sort(order, order + _size, [](const Entry* lhs,
+				const Entry* rhs) { return lhs->count > rhs->count; });
+
+		os << "top message templates of " << _records << " records:\n";
+		for (::std::size_t i = 0; i != _size; ++i) {
+			os << ::std::setw(12) << order[i]->count << "  " << order[i]->text
+					<< '\n';
+		}
+	}
+
+	void TemplateSketch::EndInterval() {
+		if (_report != 0 && _records != 0) {
+			WriteSummary(*_report);
+			_report->flush();
+		}
+		Reset();
+	}
+
+	void TemplateSketch::Reset() {
+		_start = ::std::chrono::steady_clock::now();
+		_records = 0;
+		::std::memset(_counts, 0, sizeof(_counts));
+		_size = 0;
+	}
+
+} // namespace easylogger
+
+#endif
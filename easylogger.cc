@@ -0,0 +1,18 @@
+//! \file easylogger.cc
+//!
+//! Compiled library build of Easylogger
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Builds the implementation as ordinary out-of-line functions, for
+//! programs that define EASYLOGGER_COMPILED and link libeasylogger.
+
+#if !defined(EASYLOGGER_COMPILED)
+# define EASYLOGGER_COMPILED
+#endif
+
+#include "easylogger.h"
+#include "easylogger-impl.h"
@@ -10,11 +10,155 @@
 #if !defined(EASYLOGGER_H)
 #define EASYLOGGER_H
 
-#include <iostream>
-#include <sstream>
+#include <iosfwd>
 #include <string>
+#include <atomic>
+#include <cstddef>
 #include <cstdlib>
 
+//! \def EASYLOGGER_HAVE_PMR
+//! Defined to 1 when Loggers accept a std::pmr::memory_resource.
+//!
+//! Detected for C++17 and later.  Define to 0 to leave out
+//! <memory_resource>.  It changes the layout of Logger, so a program
+//! linking libeasylogger must agree with the library.
+#if !defined(EASYLOGGER_HAVE_PMR) && defined(__has_include)
+# if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#  define EASYLOGGER_HAVE_PMR 1
+# endif
+#endif
+#if EASYLOGGER_HAVE_PMR
+# include <memory_resource>
+#endif
+
+//! \def EASYLOGGER_COMPILED
+//! Define to use Easylogger as a compiled library.
+//!
+//! By default Easylogger is header-only: every translation unit
+//! includes the whole implementation, along with <iostream> and
+//! <sstream>.  With EASYLOGGER_COMPILED defined, this header only
+//! declares the Logger API and the macros, and the implementation is
+//! taken from libeasylogger, built from easylogger.cc.  The level
+//! check of each statement stays inline; formatting and writing a
+//! record become calls into the library.  The header then includes
+//! <iosfwd> rather than <ostream>; log messages of built-in types and
+//! strings need nothing more, while values of other types need the
+//! headers their operator<< comes from.  The definition must match
+//! across the whole program.
+#if !defined(EASYLOGGER_INLINE)
+# if defined(EASYLOGGER_COMPILED)
+#  define EASYLOGGER_INLINE
+# else
+#  define EASYLOGGER_INLINE inline
+# endif
+#endif
+
+//! \def EASYLOGGER_USDT
+//! Define to compile USDT probes into every log statement and TRACE.
+//!
+//! The probes follow the sys/sdt.h conventions, so bpftrace, perf and
+//! SystemTap can attach to them:
+//!
+//!     easylogger:log(int level, char* logger, char* file, int line,
+//!             char* message)
+//!     easylogger:trace_enter(char* logger, char* file, int line,
+//!             char* func, char* name)
+//!     easylogger:trace_exit(char* logger, char* file, int line,
+//!             char* func, char* name)
+//!
+//! An untraced probe is a single NOP.  The log probe fires for every
+//! statement, including those below the Logger's level; its message
+//! is only formatted while a tracer is attached, which the tracer
+//! signals through the probe's semaphore.  A message that is also
+//! logged is formatted once, for both.  Requires an ELF target on
+//! x86-64 or AArch64.
+#if defined(EASYLOGGER_USDT) && defined(__GNUC__) && defined(__ELF__) && \
+		(defined(__x86_64__) || defined(__aarch64__))
+# define EASYLOGGER_HAVE_USDT 1
+
+# include <sstream>
+
+//! Semaphore raised by tracers attached to easylogger:log
+extern "C" {
+	__attribute__((weak, section(".probes")))
+			volatile unsigned short easylogger_log_semaphore = 0;
+}
+
+//! Emit a five-argument USDT probe
+//!
+//! \internal
+//! \param name Probe name.
+//! \param sema Semaphore symbol name as a string, or "0".
+//! \param spec Argument size specifiers, as in sys/sdt.h.
+# define _EASY_USDT5(name, sema, spec, v1, v2, v3, v4, v5) \
+	__asm__ __volatile__ ("990: nop\n" \
+		".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+		".balign 4\n" \
+		".4byte 992f-991f, 994f-993f, 3\n" \
+		"991: .asciz \"stapsdt\"\n" \
+		"992: .balign 4\n" \
+		"993: .8byte 990b\n" \
+		".8byte _.stapsdt.base\n" \
+		".8byte " sema "\n" \
+		".asciz \"easylogger\"\n" \
+		".asciz \"" #name "\"\n" \
+		".asciz \"" spec "\"\n" \
+		"994: .balign 4\n" \
+		".popsection\n" \
+		".ifndef _.stapsdt.base\n" \
+		".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+		".weak _.stapsdt.base\n" \
+		".hidden _.stapsdt.base\n" \
+		"_.stapsdt.base: .space 1\n" \
+		".size _.stapsdt.base, 1\n" \
+		".popsection\n" \
+		".endif\n" \
+		:: [a1] "nor" (v1), [a2] "nor" (v2), [a3] "nor" (v3), \
+		[a4] "nor" (v4), [a5] "nor" (v5))
+
+//! Fire the easylogger:log probe with formatted text
+//!
+//! \internal
+# define _EASY_LOG_USDT(logger, level, text) \
+	_EASY_USDT5(log, "easylogger_log_semaphore", \
+			"-4@%[a1] 8@%[a2] 8@%[a3] -4@%[a4] 8@%[a5]", \
+			static_cast<int>(level), (logger).Name(), \
+			static_cast<const char*>(__FILE__), static_cast<int>(__LINE__), \
+			static_cast<const char*>(text))
+
+//! Fire the easylogger:log probe for a message that is not logged,
+//! formatting it only while traced
+//!
+//! \internal
+# define _EASY_LOG_PROBE(logger, level, message) \
+	if (easylogger_log_semaphore != 0) { \
+		::std::ostringstream _easy_probe_os; \
+		_easy_probe_os << message; \
+		const ::std::string _easy_probe_text = _easy_probe_os.str(); \
+		_EASY_LOG_USDT((logger), (level), _easy_probe_text.c_str()); \
+	}
+
+//! Fire the easylogger:log probe for a message formatted into a LogSink
+//!
+//! \internal
+# define _EASY_LOG_PROBE_SINK(logger, level, sink) \
+	if (easylogger_log_semaphore != 0) { \
+		_EASY_LOG_USDT((logger), (level), (sink).Message()); \
+	}
+
+//! Fire a Tracer probe
+//!
+//! \internal
+# define _EASY_TRACE_PROBE(name, logger, file, line, func, scope) \
+	_EASY_USDT5(name, "0", "8@%[a1] 8@%[a2] -4@%[a3] 8@%[a4] 8@%[a5]", \
+			(logger).Name(), (file), static_cast<int>(line), (func), \
+			(scope))
+#else
+# define _EASY_LOG_PROBE(logger, level, message) do{ }while(0)
+# define _EASY_LOG_PROBE_SINK(logger, level, sink) do{ }while(0)
+# define _EASY_TRACE_PROBE(name, logger, file, line, func, scope) do{ }while(0)
+#endif
+
 //! Main namespace containing all Easylogger functionality
 namespace easylogger {
 
@@ -27,17 +171,444 @@ namespace easylogger {
 		LEVEL_INFO,		//!< Info-level messages (2)
 		LEVEL_WARNING,	//!< Warning-level messages (3)
 		LEVEL_ERROR,	//!< Error-level message (4)
-		LEVEL_FATAL		//!< Fatal-level message (5)
+		LEVEL_FATAL,	//!< Fatal-level message (5)
+		LEVEL_NONE		//!< Disables a level setting entirely (6)
+	};
+
+	//! A single log record as handed to a Sink
+	struct LogRecord {
+		LogLevel level;			//!< Level of the record
+		const Logger* logger;	//!< Logger the record was originally logged to
+		const char* file;		//!< File name of log location
+		unsigned int line;		//!< Line of file of log location
+		const char* func;		//!< Name of function at log location
+		const char* message;	//!< The unformatted log message
+		void* const* frames;	//!< Captured return addresses, innermost first
+		int depth;				//!< Number of captured frames
+		const char* format;		//!< Format string of the Logger writing it
+	};
+
+	//! Output destination for formatted log records
+	//!
+	//! A Sink receives each record together with its text, already
+	//! formatted according to the Logger's format string and terminated
+	//! with a newline.  Unlike a plain std::ostream, a Sink knows the
+	//! level and origin of every record it writes.
+	//!
+	//! A sink that formats records itself, for example on another
+	//! thread, returns true from Formats().  It is then given a NULL
+	//! text, and formats the record with FormatRecord().
+	class Sink {
+	public:
+		virtual ~Sink() {}
+
+		//! Write a single formatted record
+		//!
+		//! \param record The record being written.
+		//! \param text Formatted text of the record, or NULL.
+		//! \param length Length of text in bytes.
+		//! \returns false if the record could not be written
+		virtual bool Write(const LogRecord& record, const char* text,
+				::std::size_t length) = 0;
+
+		//! Flush any buffered output
+		virtual void Flush() {}
+
+		//! Check if the sink formats records itself
+		//!
+		//! \returns true to receive records without text
+		virtual bool Formats() const { return false; }
+
+		//! Write the records of a Batch
+		//!
+		//! The records share a level and origin.  Their texts follow
+		//! one another in a single buffer, so a sink can write them
+		//! with one call.  By default each record is passed to Write().
+		//!
+		//! \param records The records being written.
+		//! \param text Formatted texts of the records, or NULL.
+		//! \param lengths Length of each record's text in bytes.
+		//! \param count Number of records.
+		//! \returns false if any record could not be written
+		virtual bool WriteBatch(const LogRecord* records, const char* text,
+				const ::std::size_t* lengths, ::std::size_t count) {
+			bool written = true;
+			for (::std::size_t i = 0; i != count; ++i) {
+				const ::std::size_t length = text != 0 ? lengths[i] : 0;
+				written = Write(records[i], text, length) && written;
+				if (text != 0) {
+					text += length;
+				}
+			}
+			return written;
+		}
 	};
 
+	//! Format a record according to its format string
+	//!
+	//! Writes the formatted record to a stream, without the captured
+	//! frames or the trailing end of line.
+	//!
+	//! \param os Stream to format into.
+	//! \param record Record to format.
+	EASYLOGGER_INLINE void FormatRecord(::std::ostream& os,
+			const LogRecord& record);
+
 	//! Private namespace
 	//! \internal
 	namespace _private {
 
+		//! Aggregate of the records of a summarized call site
+		//!
+		//! \internal
+		struct SiteSummary {
+			EASYLOGGER_INLINE SiteSummary();
+
+			//! Add a value to the aggregate
+			EASYLOGGER_INLINE void Add(double value);
+
+			//! Records since the last summary line
+			::std::atomic<unsigned long long> count;
+
+			//! Values since the last summary line
+			::std::atomic<unsigned long long> values;
+
+			::std::atomic<double> sum;
+
+			::std::atomic<double> min;
+
+			::std::atomic<double> max;
+
+			//! Start of the current interval, in CoarseNow() nanoseconds
+			::std::atomic<long long> start;
+
+			//! Logger and level the site last logged to
+			::std::atomic<Logger*> logger;
+
+			::std::atomic<int> level;
+
+			//! Summary created before this one; summaries are never freed
+			SiteSummary* next;
+		};
+
+		//! Static description of a single logging statement
+		//!
+		//! Each LOG_* expansion defines one constant-initialized
+		//! CallSite, whose address identifies the statement.  A site
+		//! registers itself the first time it is enabled, after which
+		//! it can be switched between writing records and summarizing
+		//! them.
+		//!
+		//! \internal
+		struct CallSite {
+			//! Registration and mode of a site
+			enum State {
+				UNREGISTERED,	//!< Not yet seen by the registry
+				WRITE,			//!< Records are written normally
+				SUMMARIZE		//!< Records are only counted
+			};
+
+			const char* file;	//!< File name of log location
+			unsigned int line;	//!< Line of file of log location
+			const char* func;	//!< Name of function at log location
+
+			//! Current State of the site
+			::std::atomic<int> state;
+
+			//! Aggregate used while summarizing
+			::std::atomic<SiteSummary*> summary;
+
+			//! Next site in the registry
+			CallSite* next;
+
+			//! Check if records of this site are only being counted
+			//!
+			//! \returns true if summarizing
+			bool Summarizing() {
+				int current = state.load(::std::memory_order_acquire);
+				if (current == UNREGISTERED) {
+					current = Register();
+				}
+				return current == SUMMARIZE;
+			}
+
+			//! Count a record instead of writing it
+			//!
+			//! \param logger Logger the record is logged to.
+			//! \param level Level of the record.
+			EASYLOGGER_INLINE void Summarize(Logger& logger, LogLevel level);
+
+			//! Count a record and aggregate a value instead of writing it
+			//!
+			//! \param logger Logger the record is logged to.
+			//! \param level Level of the record.
+			//! \param value Numeric value to aggregate.
+			template <typename T>
+			void Summarize(Logger& logger, LogLevel level, const T& value) {
+				Summarize(logger, level, static_cast<double>(value));
+			}
+
+			//! Count a record and aggregate a value instead of writing it
+			//!
+			//! \param logger Logger the record is logged to.
+			//! \param level Level of the record.
+			//! \param value Value to aggregate.
+			EASYLOGGER_INLINE void Summarize(Logger& logger, LogLevel level,
+					double value);
+
+			//! Write the summary line of the current interval
+			//!
+			//! \param force Write even if the interval has not ended.
+			EASYLOGGER_INLINE void Emit(bool force);
+
+			//! Add the site to the registry and apply summary rules
+			//!
+			//! \returns the new State
+			EASYLOGGER_INLINE int Register();
+		};
+
+		//! Read the steady clock
+		//!
+		//! \internal
+		//! \returns Time in nanoseconds
+		EASYLOGGER_INLINE long long Now();
+
+		//! Read a cheap, monotonic cycle counter
+		//!
+		//! \internal
+		//! \returns TSC on x86, nanoseconds elsewhere
+		inline unsigned long long Cycles() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+			return __builtin_ia32_rdtsc();
+#else
+			return static_cast<unsigned long long>(Now());
+#endif
+		}
+
+		//! Counters of one call site in one thread's shard
+		//!
+		//! Only the owning thread writes the counters, so they are
+		//! updated with plain relaxed loads and stores.
+		//!
+		//! \internal
+		struct SiteCounters {
+			::std::atomic<const CallSite*> site;
+			::std::atomic<unsigned long long> records;
+			::std::atomic<unsigned long long> bytes;
+			::std::atomic<unsigned long long> cycles;
+		};
+
+		//! Per-thread table of call site counters
+		//!
+		//! \internal
+		struct SiteShard {
+			//! Number of call sites tracked per thread
+			enum { SIZE = 1024 };
+
+			EASYLOGGER_INLINE SiteShard();
+
+			EASYLOGGER_INLINE ~SiteShard();
+
+			//! Add one record to a call site's counters
+			EASYLOGGER_INLINE void Count(const CallSite* site,
+					unsigned long long bytes, unsigned long long cycles);
+
+			//! Open-addressed table; the last slot collects overflow
+			SiteCounters slots[SIZE];
+
+			//! Next shard in the registry
+			SiteShard* next;
+		};
+
+		//! Registry of used Loggers and interned strings
+		//!
+		//! \internal
+		struct LoggerRegistry;
+
+		//! Get the process-wide Logger registry
+		//!
+		//! \internal
+		EASYLOGGER_INLINE LoggerRegistry& Loggers();
+
+		//! Copy a string to storage kept until the process exits
+		//!
+		//! Equal strings are stored once.
+		//!
+		//! \internal
+		//! \param text String to intern.
+		//! \returns Interned copy of text
+		EASYLOGGER_INLINE const char* Intern(const ::std::string& text);
+
+		//! Get the stream of Loggers without a stream or parent
+		//!
+		//! \internal
+		//! \returns std::cout
+		EASYLOGGER_INLINE ::std::ostream& DefaultStream();
+
+		//! Registry of call sites and per-thread shards
+		//!
+		//! \internal
+		struct SiteRegistry;
+
+		//! Get the summary interval, in nanoseconds
+		//!
+		//! \internal
+		EASYLOGGER_INLINE ::std::atomic<long long>& SummaryPeriod();
+
+		//! Get the process-wide call site registry
+		//!
+		//! \internal
+		EASYLOGGER_INLINE SiteRegistry& Sites();
+
+		//! Get the flag enabling call site accounting
+		//!
+		//! \internal
+		EASYLOGGER_INLINE ::std::atomic<bool>& SiteStatsFlag();
+
+		//! Get the call site shard of the calling thread
+		//!
+		//! \internal
+		EASYLOGGER_INLINE SiteShard& ThreadSites();
+
+		//! Read-side state of one thread, for deferring Logger destruction
+		//!
+		//! A thread inside a read section publishes the global epoch
+		//! it entered at; a Logger being destroyed waits until no
+		//! thread is in a section entered at an older epoch.
+		//!
+		//! \internal
+		struct Reader {
+			EASYLOGGER_INLINE Reader();
+
+			EASYLOGGER_INLINE ~Reader();
+
+			//! Enter a read section; sections nest
+			inline void Enter();
+
+			//! Leave a read section
+			void Leave() {
+				if (--_nesting == 0) {
+					_epoch.store(0, ::std::memory_order_release);
+				}
+			}
+
+			//! Epoch the outermost section was entered at; 0 if none
+			::std::atomic<unsigned long long> _epoch;
+
+			//! Depth of nested sections
+			unsigned int _nesting;
+
+			//! Next reader in the registry
+			Reader* _next;
+		};
+
+		//! Registry of the readers of all live threads
+		//!
+		//! \internal
+		struct ReaderRegistry;
+
+		//! Get the process-wide reader registry
+		//!
+		//! \internal
+		EASYLOGGER_INLINE ReaderRegistry& Readers();
+
+		//! Get the reader of the calling thread
+		//!
+		//! \internal
+		EASYLOGGER_INLINE Reader& ThreadReader();
+
+		//! Get the global read epoch
+		//!
+		//! \internal
+		inline ::std::atomic<unsigned long long>& ReadEpoch() {
+			static ::std::atomic<unsigned long long> epoch(1);
+			return epoch;
+		}
+
+		void Reader::Enter() {
+			if (_nesting++ == 0) {
+				_epoch.store(ReadEpoch().load(::std::memory_order_acquire),
+						::std::memory_order_seq_cst);
+			}
+		}
+
+		//! Wait until all read sections entered before the call have left
+		//!
+		//! Sections of the calling thread are not waited for.
+		//!
+		//! \internal
+		EASYLOGGER_INLINE void Synchronize();
+
+		//! Text of a message and the stream writing it
+		//!
+		//! \internal
+		struct MessageText;
+
+		//! Messages of a Batch
+		//!
+		//! \internal
+		struct BatchText;
+
+		//! Stream operators for the text of a log message
+		//!
+		//! Built-in types and strings are written by the library, so a
+		//! statement logging only those compiles without <ostream>.
+		//! Values of other types, such as enums and typed pointers, go
+		//! through their operator<< on the underlying stream.
+		//!
+		//! \internal
+		class MessageStream {
+		public:
+			//! Construct stream operators for a stream
+			//!
+			//! \param os Stream the message is written to.
+			explicit MessageStream(::std::ostream* os) : _os(os) {}
+
+			//! Get the underlying stream
+			//!
+			//! \returns internal std::ostream
+			::std::ostream& Stream() { return *_os; }
+
+			//! Write a built-in value or a string to the message
+			EASYLOGGER_INLINE MessageStream& operator<<(bool value);
+			EASYLOGGER_INLINE MessageStream& operator<<(char value);
+			EASYLOGGER_INLINE MessageStream& operator<<(signed char value);
+			EASYLOGGER_INLINE MessageStream& operator<<(unsigned char value);
+			EASYLOGGER_INLINE MessageStream& operator<<(short value);
+			EASYLOGGER_INLINE MessageStream& operator<<(unsigned short value);
+			EASYLOGGER_INLINE MessageStream& operator<<(int value);
+			EASYLOGGER_INLINE MessageStream& operator<<(unsigned int value);
+			EASYLOGGER_INLINE MessageStream& operator<<(long value);
+			EASYLOGGER_INLINE MessageStream& operator<<(unsigned long value);
+			EASYLOGGER_INLINE MessageStream& operator<<(long long value);
+			EASYLOGGER_INLINE MessageStream& operator<<(
+					unsigned long long value);
+			EASYLOGGER_INLINE MessageStream& operator<<(float value);
+			EASYLOGGER_INLINE MessageStream& operator<<(double value);
+			EASYLOGGER_INLINE MessageStream& operator<<(long double value);
+			EASYLOGGER_INLINE MessageStream& operator<<(const char* value);
+			EASYLOGGER_INLINE MessageStream& operator<<(const void* value);
+			EASYLOGGER_INLINE MessageStream& operator<<(
+					const ::std::string& value);
+
+			//! Write a string held in a mutable buffer
+			MessageStream& operator<<(char* value) {
+				return *this << static_cast<const char*>(value);
+			}
+
+			//! Write an address
+			MessageStream& operator<<(void* value) {
+				return *this << static_cast<const void*>(value);
+			}
+
+		protected:
+			::std::ostream* _os;
+		};
+
 		//! Sink for log message streaming
 		//!
 		//! \internal
-		class LogSink {
+		class LogSink : public MessageStream {
 		public:
 			//! Construct a new sink
 			//!
@@ -46,26 +617,52 @@ namespace easylogger {
 			//! \param file File name of log location.
 			//! \param line Line of file of log location.
 			//! \param func Name of function at log location.
-			LogSink(Logger* logger, LogLevel level, const char* file,
-					unsigned int line, const char* func) : _logger(logger),
-					_level(level), _file(file), _line(line), _func(func) {}
+			//! \param site Call site of a LOG_* statement, if any.
+			EASYLOGGER_INLINE LogSink(Logger* logger, LogLevel level,
+					const char* file, unsigned int line, const char* func,
+					const CallSite* site = 0);
 
 			//! Copy constructor
 			//!
 			//! \param sink Source LogSink.
-			LogSink(const LogSink& sink) : _logger(sink._logger),
-					_level(sink._level), _file(sink._file), _line(sink._line),
-					_func(sink._func) {}
+			EASYLOGGER_INLINE LogSink(const LogSink& sink);
 
-			//! Get the internal stream of the sink
+			//! Capture the return addresses of the current call stack
 			//!
-			//! \returns internal std::ostream
-			::std::ostream& Stream() { return _os; }
+			//! Only raw addresses are stored; they are resolved to names
+			//! when the record is written.  Frames above the caller's,
+			//! inside Easylogger, are dropped.
+			//!
+			//! \param caller Return address into the function logging.
+#if defined(__GNUC__)
+			__attribute__((noinline))
+#endif
+			EASYLOGGER_INLINE void CaptureStack(void* caller);
+
+#if EASYLOGGER_HAVE_PMR
+			//! Set the resource used for long messages
+			//!
+			//! \param memory Memory resource.
+			EASYLOGGER_INLINE void Memory(::std::pmr::memory_resource& memory);
+#endif
 
-			inline ~LogSink();
+			//! Get the message written so far
+			//!
+			//! \returns NUL-terminated text
+			EASYLOGGER_INLINE const char* Message();
+
+			EASYLOGGER_INLINE ~LogSink();
 			
 		private:
-			::std::ostringstream _os;
+			LogSink& operator=(const LogSink&);
+
+			//! Bytes reserved for the MessageText
+			enum { TEXT_SIZE = 640 };
+
+			//! Get the text of the message
+			MessageText& Text() {
+				return *reinterpret_cast<MessageText*>(_text);
+			}
 
 			Logger* _logger;
 
@@ -76,8 +673,95 @@ namespace easylogger {
 			unsigned int _line;
 
 			const char* _func;
+
+			const CallSite* _site;
+
+			//! Cycle count at construction, if accounting call sites
+			unsigned long long _start;
+
+			//! Maximum number of captured stack frames
+			enum { MAX_FRAMES = 32 };
+
+			void* _frames[MAX_FRAMES];
+
+			int _depth;
+
+			//! MessageText, constructed in place by the implementation
+			alignas(::std::max_align_t) char _text[TEXT_SIZE];
+		};
+
+		//! Write a captured stack, one frame per line
+		//!
+		//! Each frame is written as its symbol and offset when a name
+		//! can be found, followed by module and offset, which an
+		//! offline tool such as addr2line can always resolve.
+		//! Resolved frames are cached for the life of the process.
+		//!
+		//! \internal
+		//! \param os Stream to write to.
+		//! \param frames Return addresses, innermost first.
+		//! \param depth Number of frames.
+		EASYLOGGER_INLINE void WriteStack(::std::ostream& os,
+				void* const* frames, int depth);
+
+		//! Stack of the active Tracer scopes of one thread
+		//!
+		//! Pushing and popping are plain stores; another thread may
+		//! read the stack at any time to sample where this thread is.
+		//! Scopes nested deeper than MAX_DEPTH are counted but not
+		//! recorded.
+		//!
+		//! \internal
+		struct ScopeStack {
+			//! Maximum number of recorded scope names
+			enum { MAX_DEPTH = 64 };
+
+			EASYLOGGER_INLINE ScopeStack();
+
+			EASYLOGGER_INLINE ~ScopeStack();
+
+			//! Enter a scope
+			//!
+			//! \param name Name of scope; must have static storage.
+			void Push(const char* name) {
+				const unsigned int depth = _depth.load(::std::memory_order_relaxed);
+				if (depth < MAX_DEPTH) {
+					_names[depth].store(name, ::std::memory_order_relaxed);
+				}
+				_depth.store(depth + 1, ::std::memory_order_release);
+			}
+
+			//! Leave the innermost scope
+			void Pop() {
+				_depth.store(_depth.load(::std::memory_order_relaxed) - 1,
+						::std::memory_order_release);
+			}
+
+			//! Scope names, outermost first
+			::std::atomic<const char*> _names[MAX_DEPTH];
+
+			//! Number of active scopes
+			::std::atomic<unsigned int> _depth;
+
+			//! Next stack in the registry
+			ScopeStack* _next;
 		};
 
+		//! Registry of the scope stacks of all live threads
+		//!
+		//! \internal
+		struct ScopeRegistry;
+
+		//! Get the process-wide scope stack registry
+		//!
+		//! \internal
+		EASYLOGGER_INLINE ScopeRegistry& Scopes();
+
+		//! Get the scope stack of the calling thread
+		//!
+		//! \internal
+		EASYLOGGER_INLINE ScopeStack& ThreadScopes();
+
 		//! Tracer that handles exits at end of scope
 		//!
 		//! \internal
@@ -92,14 +776,16 @@ namespace easylogger {
 			//! \param line Line number of file at trace point.
 			//! \param func Name of function at trace point.
 			//! \param name Name of trace point.
-			inline Tracer(Logger& logger, const char* file, unsigned int line,
-					const char* func, const char* name);
+			EASYLOGGER_INLINE Tracer(Logger& logger, const char* file,
+					unsigned int line, const char* func, const char* name);
 
-			inline ~Tracer();
+			EASYLOGGER_INLINE ~Tracer();
 
 		private:
 			Logger& _logger;
 
+			ScopeStack& _scopes;
+
 			const char* _file;
 
 			const char* _func;
@@ -107,42 +793,322 @@ namespace easylogger {
 			const char* _name;
 		};
 
+		//! Scope that logs only when it runs longer than a threshold
+		//!
+		//! A SlowScope records the time it was entered and, on exit,
+		//! writes a single record if the elapsed time reached the
+		//! threshold.  Nothing is formatted or written otherwise.
+		//! When slow scopes nest, a slow inner scope is also noted on
+		//! the enclosing one, so the outer record shows which parts of
+		//! it were slow; up to MAX_NOTES are named, the rest counted.
+		//!
+		//! \internal
+		class SlowScope {
+		public:
+			//! Maximum number of slow inner scopes noted per scope
+			enum { MAX_NOTES = 8 };
+
+			//! Construct a new SlowScope instance.
+			//!
+			//! This is meant to be used by the SLOW_SCOPE macro.
+			//!
+			//! \param logger Logger instance to log to.
+			//! \param level Level of the record of a slow scope.
+			//! \param file Name of file at scope.
+			//! \param line Line number of file at scope.
+			//! \param func Name of function at scope.
+			//! \param name Name of scope.
+			//! \param threshold Minimum elapsed microseconds to log.
+			EASYLOGGER_INLINE SlowScope(Logger& logger, LogLevel level,
+					const char* file, unsigned int line, const char* func,
+					const char* name, unsigned long threshold);
+
+			EASYLOGGER_INLINE ~SlowScope();
+
+		private:
+			SlowScope(const SlowScope&);
+			SlowScope& operator=(const SlowScope&);
+
+			//! Get the innermost SlowScope of the calling thread
+			static EASYLOGGER_INLINE SlowScope*& Current();
+
+			Logger& _logger;
+
+			LogLevel _level;
+
+			const char* _file;
+
+			unsigned int _line;
+
+			const char* _func;
+
+			const char* _name;
+
+			unsigned long _threshold;
+
+			//! Now() at construction
+			long long _start;
+
+			SlowScope* _outer;
+
+			unsigned int _noted;
+
+			const char* _note_names[MAX_NOTES];
+
+			unsigned long _note_times[MAX_NOTES];
+		};
+
 	} // namespace _private
 
+	//! Sort order of a call site report
+	enum SiteSort {
+		SORT_RECORDS,	//!< Most records first
+		SORT_BYTES,		//!< Most message bytes first
+		SORT_CYCLES		//!< Most cycles spent logging first
+	};
+
+	//! Enable or disable per-call-site accounting
+	//!
+	//! While enabled, every record written by a LOG_* statement adds
+	//! to per-thread counters of that statement: records, message
+	//! bytes, and cycles spent from creating the LogSink to the end of
+	//! WriteLog.  Disabled by default; when disabled, a record costs
+	//! one extra relaxed load.
+	//!
+	//! \param enable true to enable accounting.
+	EASYLOGGER_INLINE void SiteStats(bool enable);
+
+	//! Write a report of the busiest call sites
+	//!
+	//! Counters of all threads, live and exited, are summed per call
+	//! site and written as one line per site, busiest first.
+	//!
+	//! \param os Stream to write the report to.
+	//! \param sort Column to sort by.
+	//! \param limit Maximum number of sites; 0 for all.
+	EASYLOGGER_INLINE void SiteReport(::std::ostream& os,
+			SiteSort sort = SORT_BYTES, ::std::size_t limit = 0);
+
+	//! Reset all call site counters to zero
+	EASYLOGGER_INLINE void ResetSiteStats();
+
+	//! Switch LOG_* statements between writing and summarizing
+	//!
+	//! A summarized statement does not format or write its records.
+	//! It only counts them, and for LOG_VALUE also aggregates the
+	//! minimum, maximum and mean of the value.  Once per summary
+	//! interval a single line with the aggregate is written at the
+	//! statement's level and location.  FATAL records are always
+	//! written.
+	//!
+	//! The switch applies to statements already executed and to those
+	//! that execute later.  A later call overrides an earlier one for
+	//! the statements both match.
+	//!
+	//! \param file File name, or its trailing path components, to match;
+	//! "log.cc" matches "src/log.cc" but not "src/dialog.cc".
+	//! \param line Line of the statement; 0 matches the whole file.
+	//! \param summarize true to summarize, false to write normally.
+	EASYLOGGER_INLINE void Summarize(const char* file, unsigned int line,
+			bool summarize);
+
+	//! Set how often summarized statements write their summary line
+	//!
+	//! \param interval Milliseconds between summary lines; default
+	//! 10000.
+	EASYLOGGER_INLINE void SummaryInterval(unsigned long interval);
+
+	//! Write the pending summary lines of all summarized statements
+	//!
+	//! Called at exit once any statement has been summarized.
+	EASYLOGGER_INLINE void FlushSummaries();
+
+	//! Scope within which no Logger in use is destroyed
+	//!
+	//! A Logger's destructor waits until every other thread that was
+	//! inside a ReadSection when destruction began has left it.  A
+	//! thread that finds a Logger shared with other threads, for
+	//! example with FindLogger() or in a table of connections, should
+	//! find it and log to it within one ReadSection, while the owner
+	//! removes the Logger from where it can be found before
+	//! destroying it.  The section must cover the whole LOG_*
+	//! statement, whose level check reads the Logger first; records
+	//! do not enter a section of their own.
+	//!
+	//! Sections nest and cost two stores.  Do not destroy a Logger
+	//! inside a section while other threads may do the same.
+	class ReadSection {
+	public:
+		ReadSection() : _reader(_private::ThreadReader()) {
+			_reader.Enter();
+		}
+
+		~ReadSection() { _reader.Leave(); }
+
+	private:
+		ReadSection(const ReadSection&);
+		ReadSection& operator=(const ReadSection&);
+
+		_private::Reader& _reader;
+	};
+
+	//! Find a Logger by name
+	//!
+	//! Only Loggers that have been used, by logging or by checking or
+	//! setting a level, are found.  Use the result within the same
+	//! ReadSection if Loggers may be destroyed concurrently.
+	//!
+	//! \param name Name of the Logger.
+	//! \returns the Logger, or NULL if none is found
+	EASYLOGGER_INLINE Logger* FindLogger(const char* name);
+
+	//! Records logged to a Logger as one unit
+	//!
+	//! A Batch checks the level once when it is created, gathers the
+	//! messages added to it, and writes them together on Commit() or
+	//! when destroyed.  Each Logger formats the whole batch at once,
+	//! flushes its stream once rather than once per record, and hands
+	//! the texts to its sink in one WriteBatch() call.  Use it for
+	//! many records from one place, such as the rows of a table dump.
+	//!
+	//! All records of a batch have the batch's level and location, and
+	//! no backtrace frames.  A FATAL batch does not abort.  A batch is
+	//! used by the thread that created it; as for LOG_*, open it inside
+	//! a ReadSection if the Logger is shared.
+	//!
+	//! \see LOG_BATCH, BATCH_LOG
+	class Batch {
+	public:
+		//! Open a batch
+		//!
+		//! \param logger Logger to log to.
+		//! \param level Level of the records.
+		//! \param file Name of file at point of log.
+		//! \param line Line of file at point of log.
+		//! \param func Name of function at point of log.
+		EASYLOGGER_INLINE Batch(Logger& logger, LogLevel level,
+				const char* file, unsigned int line, const char* func);
+
+		//! Commit the records added since the last commit
+		EASYLOGGER_INLINE ~Batch();
+
+		//! Check if the Logger accepts the batch's level
+		//!
+		//! \returns false if added records are discarded
+		bool Active() const { return _active; }
+
+		//! Get the number of records added since the last commit
+		//!
+		//! \returns Count of records.
+		EASYLOGGER_INLINE ::std::size_t Size() const;
+
+		//! Start a new record
+		//!
+		//! \returns Stream to write the record's message to.
+		EASYLOGGER_INLINE _private::MessageStream& Add();
+
+		//! Write the records added so far
+		//!
+		//! The batch stays open and may be added to again.
+		EASYLOGGER_INLINE void Commit();
+
+	private:
+		Batch(const Batch&);
+		Batch& operator=(const Batch&);
+
+		//! Messages added since the last commit; NULL until the first
+		_private::BatchText* _text;
+
+		//! Stream operators writing to _text
+		_private::MessageStream _stream;
+
+		Logger& _logger;
+
+		LogLevel _level;
+
+		const char* _file;
+
+		unsigned int _line;
+
+		const char* _func;
+
+		bool _active;
+	};
+
 	//! Logger system core class
 	class Logger {
 	public:
 		//! Construct a new Logger
 		//!
-		//! \param name Name of logger used in log messages.
-		Logger(const ::std::string& name) : _name(name), _parent(0),
-				_level(LEVEL_INFO), _stream(&::std::cout),
-				_format("[%F:%C %P] %N %L: %S") {}
+		//! The constructor is constexpr, so a Logger with static
+		//! storage is constant-initialized: it costs nothing at
+		//! startup and may be used by other static initializers.  The
+		//! Logger joins the registry searched by FindLogger() the first
+		//! time it is used.
+		//!
+		//! \param name Name of logger used in log messages; must
+		//! outlive the Logger, as a string literal does.
+		constexpr Logger(const char* name) : _name(name), _parent(0),
+				_level(UNREGISTERED), _backtrace(LEVEL_NONE), _stream(0),
+				_detached(false), _sink(0), _format("[%F:%C %P] %N %L: %S"),
+				_next(0), _link(0) {}
 
 		//! Construct a new Logger with a parent
 		//!
+		//! The Logger uses its parent's format until given its own,
+		//! and allocates nothing, so short-lived Loggers, such as one
+		//! per connection, are cheap.  The name is borrowed; keep it
+		//! in the object the Logger belongs to.
+		//!
+		//! \param name Name of logger used in log messages; must
+		//! outlive the Logger.
+		//! \param parent Parent Logger all messages are forwarded to.
+		constexpr Logger(const char* name, Logger& parent) : _name(name),
+				_parent(&parent), _level(UNREGISTERED), _backtrace(LEVEL_NONE),
+				_stream(0), _detached(false), _sink(0), _format(0), _next(0),
+				_link(0) {}
+
+		//! Construct a new Logger with a name built at runtime
+		//!
+		//! The name is interned; it is kept until the process exits.
+		//! For many short-lived Loggers, borrow the name instead.
+		//!
+		//! \param name Name of logger used in log messages.
+		EASYLOGGER_INLINE explicit Logger(const ::std::string& name);
+
+		//! Construct a new Logger with a parent and a name built at runtime
+		//!
 		//! \param name Name of logger used in log messages.
 		//! \param parent Parent Logger all messages are forwarded to.
-		Logger(const ::std::string& name, Logger& parent) : _name(name),
-				_parent(&parent), _level(LEVEL_INFO), _stream(0),
-				_format("[%F:%C %P] %N %L: %S") {}
+		EASYLOGGER_INLINE Logger(const ::std::string& name, Logger& parent);
 
-		~Logger() {}
+		//! Destroy the Logger
+		//!
+		//! Waits for other threads still inside a ReadSection; see
+		//! ReadSection.
+		EASYLOGGER_INLINE ~Logger();
 
 		//! Get the name of the Logger
 		//!
 		//! \returns Logger's name
-		const ::std::string& Name() const { return _name; }
+		const char* Name() const { return _name; }
 
 		//! Get the minimum log level of the Logger
 		//!
+		//! Registers the Logger, as a parent is when a child logs
+		//! through it.
+		//!
 		//! \returns Minimum log level
-		LogLevel Level() const { return _level; }
+		LogLevel Level() const {
+			const int current = _level.load(::std::memory_order_relaxed);
+			return static_cast<LogLevel>(current == UNREGISTERED ?
+					Register() : current);
+		}
 
 		//! Set the minimum log level of the Logger
 		//!
 		//! \returns New minimum log level
-		LogLevel Level(LogLevel level) { return _level = level; }
+		EASYLOGGER_INLINE LogLevel Level(LogLevel level);
 
 		//! Checks if this Logger or any ancestor accepts a given log level
 		//!
@@ -153,23 +1119,73 @@ namespace easylogger {
 		//!
 		//! \param level Log level to check for.
 		//! \returns true if any ancestor will accept log level
-		inline bool IsLevel(LogLevel level) const;
+		bool IsLevel(LogLevel level) const {
+			// an unregistered Logger passes the first test, so
+			// registration costs nothing once the level is set
+			const int current = _level.load(::std::memory_order_relaxed);
+			return (current <= level && (current != UNREGISTERED ||
+					Register() <= level)) ||
+					(_parent != 0 && _parent->IsLevel(level));
+		}
+
+		//! Get the minimum level at which stack traces are captured
+		//!
+		//! \returns Minimum backtrace level; LEVEL_NONE if disabled.
+		LogLevel Backtrace() const { return _backtrace; }
+
+		//! Set the minimum level at which stack traces are captured
+		//!
+		//! Messages of this level or higher logged to this Logger or
+		//! any of its descendants capture the return addresses of the
+		//! call stack.  Capturing only copies addresses; symbolizing
+		//! is deferred until the record is written and cached.  Use
+		//! LEVEL_FATAL to capture failed assertions, or LEVEL_NONE to
+		//! disable capture, which is the default.
+		//!
+		//! \param level Minimum backtrace level.
+		//! \returns New minimum backtrace level.
+		EASYLOGGER_INLINE LogLevel Backtrace(LogLevel level);
+
+		//! Checks if this Logger or any ancestor captures stacks at a level
+		//!
+		//! \param level Log level to check for.
+		//! \returns true if any ancestor wants a backtrace
+		EASYLOGGER_INLINE bool IsBacktrace(LogLevel level) const;
 
 		//! Create a new log sink
 		//!
 		//! Does the actual work of writing log message.
 		//!
+		//! Never inlined, so that its return address identifies the
+		//! frame of the function logging.
+		//!
 		//! \param level Level of log message.
 		//! \param file Name of file at point of log.
 		//! \param line Line of file at point of log.
 		//! \param func Name of function at point of log.
-		inline _private::LogSink Log(LogLevel level, const char* file,
-				unsigned int line, const char* func);
+#if defined(__GNUC__)
+		__attribute__((noinline))
+#endif
+		EASYLOGGER_INLINE _private::LogSink Log(LogLevel level,
+				const char* file, unsigned int line, const char* func);
+
+		//! Create a new log sink for a LOG_* call site
+		//!
+		//! \param level Level of log message.
+		//! \param site Call site of log statement.
+#if defined(__GNUC__)
+		__attribute__((noinline))
+#endif
+		EASYLOGGER_INLINE _private::LogSink Log(LogLevel level,
+				const _private::CallSite& site);
 
 		//! Get the underlying stream
 		//!
+		//! Only valid while the Logger has a stream of its own, or is a
+		//! root Logger writing to the default stream.
+		//!
 		//! \returns underlying stream
-		::std::ostream& Stream() const { return *_stream; }
+		::std::ostream& Stream() const { return *Destination(); }
 
 		//! Set the underlying stream
 		//!
@@ -180,23 +1196,107 @@ namespace easylogger {
 		//!
 		//! \param stream New underlying stream.
 		//! \returns New underlying stream.
-		inline ::std::ostream& Stream(::std::ostream& stream);
+		EASYLOGGER_INLINE ::std::ostream& Stream(::std::ostream& stream);
+
+		//! Stop writing records to a stream
+		//!
+		//! Records still go to the sink and to ancestors.  Use this when
+		//! the sink is the only output, so records are not formatted
+		//! for a stream nobody reads.  Setting a stream again with
+		//! Stream() undoes it.
+		void DetachStream() {
+			_stream = 0;
+			_detached = true;
+		}
+
+		//! Get the attached sink
+		//!
+		//! \returns attached Sink, or NULL if none is attached
+		Sink* Output() const { return _sink; }
+
+		//! Attach a sink
+		//!
+		//! The sink receives every record this Logger writes, in
+		//! addition to the underlying stream.  As with Stream(), the
+		//! sink is not copied; it must outlive the Logger.
+		//!
+		//! \param sink New sink.
+		//! \returns New sink.
+		EASYLOGGER_INLINE Sink& Output(Sink& sink);
+
+		//! Detach the current sink, if any
+		void DetachOutput() { _sink = 0; }
 
 		//! Get the log format string
 		//!
-		//! \returns Log format string.
-		const ::std::string& Format() const { return _format; }
+		//! \returns Log format string, which may be the parent's.
+		const char* Format() const {
+			const Logger* logger = this;
+			while (logger->_format == 0) {
+				logger = logger->_parent;
+			}
+			return logger->_format;
+		}
 
 		//! Set the log format string
 		//!
+		//! The format string is interned; it is kept until the process
+		//! exits.
+		//!
 		//! \param format New log format string.
 		//! \returns Log format string.
-		const ::std::string& Format(const ::std::string& format);
+		EASYLOGGER_INLINE const char* Format(const ::std::string& format);
+
+#if EASYLOGGER_HAVE_PMR
+		//! Get the memory resource used for records
+		//!
+		//! \returns Resource of the Logger or of its nearest ancestor
+		//! that has one, or the default resource
+		EASYLOGGER_INLINE ::std::pmr::memory_resource& Memory() const;
+
+		//! Set the memory resource used for records
+		//!
+		//! Buffers of records logged to this Logger and to descendants
+		//! without a resource of their own are allocated from the
+		//! resource: messages longer than a few hundred bytes, Batch
+		//! messages, and the text handed to Sinks.  Sinks that queue or
+		//! buffer records allocate their own memory from the global
+		//! heap.  The resource must be usable from every thread logging
+		//! to the Logger, and must outlive it.
+		//!
+		//! \param memory New memory resource.
+		//! \returns New memory resource.
+		::std::pmr::memory_resource& Memory(
+				::std::pmr::memory_resource& memory) {
+			_memory = &memory;
+			return memory;
+		}
+#endif
 
-		//! Flushes underlying output stream
-		void Flush() { _stream->flush(); }
+		//! Flushes underlying output stream and sink, and those of all
+		//! ancestors
+		EASYLOGGER_INLINE void Flush();
 	
 	private:
+		Logger(const Logger&);
+		Logger& operator=(const Logger&);
+
+		//! Level of a Logger not yet in the registry
+		enum { UNREGISTERED = -1 };
+
+		//! Add the Logger to the registry, if it is not yet
+		//!
+		//! \returns Minimum log level
+		EASYLOGGER_INLINE int Register() const;
+
+		//! Get the stream records are written to
+		//!
+		//! \returns Stream, or NULL if records are only forwarded
+		::std::ostream* Destination() const {
+			return _stream != 0 || _parent != 0 || _detached ? _stream :
+					&_private::DefaultStream();
+		}
+
 		//! Write log to stream
 		//!
 		//! Does the actual work of writing log message.
@@ -207,50 +1307,109 @@ namespace easylogger {
 		//! \param line Line of file at point of log.
 		//! \param func Name of function at point of log.
 		//! \param message The log message.
-		void WriteLog(LogLevel level, Logger* logger, const char* file,
-				unsigned int line, const char* func, const char* message);
+		//! \param frames Captured stack frames, if any.
+		//! \param depth Number of captured stack frames.
+		EASYLOGGER_INLINE void WriteLog(LogLevel level, Logger* logger,
+				const char* file, unsigned int line, const char* func,
+				const char* message, void* const* frames, int depth);
+
+		//! Write the records of a batch to stream and sink
+		//!
+		//! \param level Level of the records.
+		//! \param logger Original Logger target of the records.
+		//! \param file Name of file at point of log.
+		//! \param line Line of file at point of log.
+		//! \param func Name of function at point of log.
+		//! \param messages NUL-separated log messages.
+		//! \param starts Offset of each message.
+		//! \param count Number of records.
+		EASYLOGGER_INLINE void WriteBatch(LogLevel level, Logger* logger,
+				const char* file, unsigned int line, const char* func,
+				const char* messages, const ::std::size_t* starts,
+				::std::size_t count);
 
-		::std::string _name;
+		const char* _name;
 
 		Logger* _parent;
 
-		LogLevel _level;
+		//! Minimum log level, or UNREGISTERED
+		mutable ::std::atomic<int> _level;
 
+		LogLevel _backtrace;
+
+		//! Stream, or NULL for std::cout on a Logger without a parent
 		::std::ostream* _stream;
 
-		::std::string _format;
+		//! Set by DetachStream(); a NULL stream then means no stream
+		bool _detached;
+
+		Sink* _sink;
+
+		//! Format string, or NULL to use the parent's
+		const char* _format;
+
+		//! Next Logger in the registry
+		mutable Logger* _next;
+
+		//! Link pointing at this Logger in the registry
+		mutable Logger** _link;
+
+#if EASYLOGGER_HAVE_PMR
+		//! Memory resource, or NULL to use the parent's
+		::std::pmr::memory_resource* _memory = 0;
+#endif
 
 		friend class _private::LogSink;
+
+		friend class Batch;
+
+		friend Logger* FindLogger(const char* name);
 	};
 
 } // namespace easylogger
 
-//! Stream operator for LogSink
+//! Stream operator for values without a MessageStream overload
 template <typename T>
-::easylogger::_private::LogSink& operator<<(::easylogger::_private::LogSink& sink, const T& val) {
-	sink.Stream() << val;
-	return sink;
+::easylogger::_private::MessageStream& operator<<(::easylogger::_private::MessageStream& stream, const T& val) {
+	stream.Stream() << val;
+	return stream;
 }
 
-//! General logging helper
+//! Logging helper for a single call site
 //!
 //! \internal
 //! \param logger Logger to log to.
 //! \param level Level to log at
+//! \param summarize Statement run instead while the site is summarized.
 //! \param message Stream message.
-#define _EASY_LOG(logger, level, message) do{ \
+#define _EASY_LOG_SITE(logger, level, summarize, message) do{ \
 		if ((logger).IsLevel((level))) { \
-			do { \
-				::easylogger::_private::LogSink _easy_sink((logger).Log(level, __FILE__, __LINE__, __FUNCTION__)); \
+			static ::easylogger::_private::CallSite _easy_site = { __FILE__, __LINE__, __FUNCTION__, {0}, {0}, 0 }; \
+			if ((level) != ::easylogger::LEVEL_FATAL && _easy_site.Summarizing()) { \
+				summarize; \
+				_EASY_LOG_PROBE((logger), (level), message); \
+			} else { \
+				::easylogger::_private::LogSink _easy_sink((logger).Log(level, _easy_site)); \
 				_easy_sink << message; \
-			} while(0); \
+				_EASY_LOG_PROBE_SINK((logger), (level), _easy_sink); \
+			} \
 			if ((level) == ::easylogger::LEVEL_FATAL) { \
 				(logger).Flush(); \
 				std::abort(); \
 			} \
+		} else { \
+			_EASY_LOG_PROBE((logger), (level), message); \
 		} \
 	}while(0)
 
+//! General logging helper
+//!
+//! \internal
+//! \param logger Logger to log to.
+//! \param level Level to log at
+//! \param message Stream message.
+#define _EASY_LOG(logger, level, message) _EASY_LOG_SITE(logger, level, _easy_site.Summarize((logger), (level)), message)
+
 #define LOG_TRACE(logger, message) _EASY_LOG((logger), ::easylogger::LEVEL_TRACE, message)
 #define LOG_DEBUG(logger, message) _EASY_LOG((logger), ::easylogger::LEVEL_DEBUG, message)
 #define LOG_INFO(logger, message) _EASY_LOG((logger), ::easylogger::LEVEL_INFO, message)
@@ -258,6 +1417,23 @@ template <typename T>
 #define LOG_ERROR(logger, message) _EASY_LOG((logger), ::easylogger::LEVEL_ERROR, message)
 #define LOG_FATAL(logger, message) _EASY_LOG((logger), ::easylogger::LEVEL_FATAL, message)
 
+//! Log a message carrying a numeric value
+//!
+//! Behaves as a plain LOG_* statement, except that while the
+//! statement is summarized the value's minimum, maximum and mean are
+//! included in the summary line.
+#define LOG_VALUE(logger, level, value, message) _EASY_LOG_SITE((logger), (level), _easy_site.Summarize((logger), (level), (value)), message)
+
+//! Open a Batch named name, committed when it goes out of scope
+#define LOG_BATCH(logger, level, name) ::easylogger::Batch name((logger), (level), __FILE__, __LINE__, __FUNCTION__)
+
+//! Add a record to a Batch; the message is only formatted if active
+#define BATCH_LOG(batch, message) do{ \
+		if ((batch).Active()) { \
+			(batch).Add() << message; \
+		} \
+	}while(0)
+
 
 #if !defined(NDEBUG)
 # define ASSERT(logger, expr, msg) do{ \
@@ -277,6 +1453,11 @@ template <typename T>
 
 #define TRACE(logger, name) ::easylogger::_private::Tracer easy_trace_ ## name((logger), __FILE__, __LINE__, __FUNCTION__, #name)
 
-#include "easylogger-impl.h"
+#define SLOW_SCOPE_LEVEL(logger, level, name, usec) ::easylogger::_private::SlowScope easy_slow_ ## name((logger), (level), __FILE__, __LINE__, __FUNCTION__, #name, (usec))
+#define SLOW_SCOPE(logger, name, usec) SLOW_SCOPE_LEVEL((logger), ::easylogger::LEVEL_WARNING, name, (usec))
+
+#if !defined(EASYLOGGER_COMPILED)
+# include "easylogger-impl.h"
+#endif
 
 #endif
@@ -0,0 +1,55 @@
+//! \file footprint.cc
+//!
+//! Call site code footprint of Easylogger macros
+//!
+//! Copyright (C) 2010 Sean Middleditch <sean@middleditch.us>
+//!
+//! Easylogger is free software; you can redistribute it and/or modify
+//! it under the terms of the MIT license. See LICENSE for details.
+//!
+//! Each function below holds exactly one expansion of a macro, and
+//! site_none holds none.  `make footprint` compiles this file and
+//! reports how many bytes of machine code and data each function adds
+//! over site_none, which is the cost of one call site of that macro.
+//! Code shared by all sites, such as WriteLog, is emitted once and is
+//! not counted.
+
+#include "easylogger.h"
+
+#define EASY_SITE extern "C" __attribute__((noinline))
+
+EASY_SITE void site_none(easylogger::Logger& logger, int value) {
+	(void)logger;
+	(void)value;
+}
+
+EASY_SITE void site_log_info(easylogger::Logger& logger, int value) {
+	LOG_INFO(logger, "value is " << value);
+}
+
+EASY_SITE void site_log_literal(easylogger::Logger& logger, int value) {
+	(void)value;
+	LOG_INFO(logger, "constant message");
+}
+
+EASY_SITE void site_log_fatal(easylogger::Logger& logger, int value) {
+	LOG_FATAL(logger, "value is " << value);
+}
+
+EASY_SITE void site_log_value(easylogger::Logger& logger, int value) {
+	LOG_VALUE(logger, easylogger::LEVEL_INFO, value, "value is " << value);
+}
+
+EASY_SITE void site_trace(easylogger::Logger& logger, int value) {
+	(void)value;
+	TRACE(logger, scope);
+}
+
+EASY_SITE void site_slow_scope(easylogger::Logger& logger, int value) {
+	(void)value;
+	SLOW_SCOPE(logger, scope, 1000);
+}
+
+EASY_SITE void site_assert(easylogger::Logger& logger, int value) {
+	ASSERT(logger, value != 0, "value must not be zero");
+}
@@ -0,0 +1,146 @@
+//! Test of easylogger-functrace.cc
+//!
+//! Built with -finstrument-functions and linked against
+//! easylogger-functrace.o; -rdynamic lets dladdr() name the functions.
+
+#include "easylogger-functrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include <pthread.h>
+
+#define EASY_NO_INSTRUMENT __attribute__((no_instrument_function))
+
+//! Check a condition, exiting with a nonzero status if it is false
+#define EXPECT(cond, what) do { \
+		if (!(cond)) { \
+			Fail(__FILE__, __LINE__, #cond, (what)); \
+		} \
+	} while (0)
+
+EASY_NO_INSTRUMENT static void Fail(const char* file, int line,
+		const char* cond, const char* what) {
+	std::fprintf(stderr, "%s:%d: check failed: %s (%s)\n", file, line, what,
+			cond);
+	std::exit(1);
+}
+
+//! Count the occurrences of a string
+EASY_NO_INSTRUMENT static int Count(const std::string& text,
+		const std::string& what) {
+	int count = 0;
+	for (std::string::size_type pos = text.find(what);
+			pos != std::string::npos; pos = text.find(what, pos + 1)) {
+		++count;
+	}
+	return count;
+}
+
+//! Dump the trace with symbol names
+EASY_NO_INSTRUMENT static std::string Trace() {
+	std::ostringstream os;
+	easylogger::functrace::Dump(os, true);
+	return os.str();
+}
+
+extern "C" __attribute__((noinline)) void traced_inner() {
+	__asm__ __volatile__("");
+}
+
+extern "C" __attribute__((noinline)) void traced_outer() {
+	traced_inner();
+}
+
+extern "C" __attribute__((noinline)) void traced_worker() {
+	__asm__ __volatile__("");
+}
+
+//! Calls an instrumented function while its thread is exiting
+struct Late {
+	bool armed;
+
+	EASY_NO_INSTRUMENT ~Late() {
+		if (armed) {
+			traced_worker();
+		}
+	}
+};
+
+static thread_local Late late = { false };
+
+//! Passed once Worker has set up late, and again once tracing started
+static pthread_barrier_t started;
+
+EASY_NO_INSTRUMENT static void* Worker(void*) {
+	// registers the destructor of late before tracing starts, so that
+	// it runs after the tracer's own per-thread state is destroyed
+	late.armed = true;
+	pthread_barrier_wait(&started);
+	pthread_barrier_wait(&started);
+	traced_worker();
+	return 0;
+}
+
+EASY_NO_INSTRUMENT int main() {
+	easylogger::functrace::Capacity(64);
+
+	// nested calls are recorded and named
+	easylogger::functrace::Start();
+	traced_outer();
+	easylogger::functrace::Stop();
+	traced_inner();
+
+	std::ostringstream os;
+	os.precision(2);
+	os << std::hex;
+	const std::ios_base::fmtflags flags = os.flags();
+	easylogger::functrace::Dump(os, true);
+	EXPECT(os.flags() == flags, "Dump restores the flags");
+	EXPECT(os.precision() == 2, "Dump restores the precision");
+
+	std::string trace = os.str();
+	EXPECT(Count(trace, "\"name\":\"traced_outer\"") == 2, "outer traced");
+	EXPECT(Count(trace, "\"name\":\"traced_inner\"") == 2,
+			"inner traced until Stop");
+	EXPECT(trace.find("{\"ph\":\"B\"") < trace.find("{\"ph\":\"E\""),
+			"entry before exit");
+
+	// Clear discards what was recorded, even while tracing
+	easylogger::functrace::Start();
+	traced_inner();
+	easylogger::functrace::Clear();
+	traced_outer();
+	easylogger::functrace::Stop();
+	trace = Trace();
+	EXPECT(Count(trace, "\"name\":\"traced_outer\"") == 2,
+			"recorded after Clear");
+	EXPECT(Count(trace, "\"name\":\"traced_inner\"") == 2,
+			"discarded by Clear");
+
+	// nothing is recorded after the ring of an exiting thread is
+	// released, and Clear releases it
+	easylogger::functrace::Clear();
+	pthread_barrier_init(&started, 0, 2);
+	pthread_t thread;
+	EXPECT(pthread_create(&thread, 0, Worker, 0) == 0, "thread started");
+	pthread_barrier_wait(&started);
+	easylogger::functrace::Start();
+	pthread_barrier_wait(&started);
+	pthread_join(thread, 0);
+	pthread_barrier_destroy(&started);
+	trace = Trace();
+	EXPECT(Count(trace, "\"name\":\"traced_worker\"") == 2,
+			"not recorded while the thread exits");
+	easylogger::functrace::Clear();
+	traced_worker();
+	easylogger::functrace::Stop();
+	trace = Trace();
+	EXPECT(Count(trace, "\"name\":\"traced_worker\"") == 2,
+			"exited thread's ring released");
+
+	std::printf("functrace checks passed\n");
+	return 0;
+}
@@ -1,27 +1,1001 @@
 #include "easylogger.h"
+#include "easylogger-file.h"
+#include "easylogger-gzip.h"
+#include "easylogger-failover.h"
+#include "easylogger-async.h"
+#include "easylogger-parallel.h"
+#include "easylogger-sketch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dlfcn.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#if EASYLOGGER_HAVE_PMR
+# include <memory_resource>
+#endif
 
 static easylogger::Logger TEST("TEST");
-static easylogger::Logger TRACE("TRACE");
+static easylogger::Logger TRACING("TRACE");
 static easylogger::Logger SUB("SUB", TEST);
+static easylogger::Logger CHECK("CHECK");
+
+// a child defined ahead of its parent; both are constant-initialized
+extern easylogger::Logger EARLY;
+easylogger::Logger EARLY_CHILD("EARLY.CHILD", EARLY);
+easylogger::Logger EARLY("EARLY");
+
+//! Check a condition, exiting with a nonzero status if it is false
+//!
+//! Unlike ASSERT, checks stay in NDEBUG builds.
+#define EXPECT(cond, what) do { \
+		if (!(cond)) { \
+			Fail(__FILE__, __LINE__, #cond, (what)); \
+		} \
+	} while (0)
+
+static void Fail(const char* file, int line, const char* cond,
+		const char* what) {
+	std::fprintf(stderr, "%s:%d: check failed: %s (%s)\n", file, line, what,
+			cond);
+	std::exit(1);
+}
+
+//! Number of allocations from the global operator new
+static std::atomic<unsigned long> global_allocations(0);
+
+void* operator new(std::size_t size) {
+	++global_allocations;
+	if (void* data = std::malloc(size != 0 ? size : 1)) {
+		return data;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* data) noexcept {
+	std::free(data);
+}
+
+void operator delete(void* data, std::size_t) noexcept {
+	std::free(data);
+}
+
+//! Make a Logger write bare messages, to its sink only
+static void Quiet(easylogger::Logger& log) {
+	log.Format("%S");
+	log.DetachStream();
+}
+
+//! Sink keeping the text of every record, optionally held back
+struct Collect : easylogger::Sink {
+	Collect() : hold(false), fail(false) {}
+
+	bool Write(const easylogger::LogRecord& record, const char* text,
+			std::size_t length) {
+		while (hold.load()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (fail.load()) {
+			return false;
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		lines.push_back(std::string(text, length));
+		names.push_back(record.logger->Name());
+		return true;
+	}
+
+	std::mutex lock;
+	std::atomic<bool> hold;
+	std::atomic<bool> fail;
+	std::vector<std::string> lines;
+	std::vector<std::string> names;
+};
+
+//! Get the text of records "n=first" to "n=last-1"
+static std::string Numbered(int first, int last) {
+	std::ostringstream text;
+	for (int i = first; i != last; ++i) {
+		text << "n=" << i << "\n";
+	}
+	return text.str();
+}
+
+//! Check that lines are "n=0" to "n=count-1" in order
+static bool InOrder(const std::vector<std::string>& lines, int count) {
+	if (lines.size() != static_cast<std::size_t>(count)) {
+		return false;
+	}
+	for (int i = 0; i != count; ++i) {
+		std::ostringstream expected;
+		expected << "n=" << i << "\n";
+		if (lines[i] != expected.str()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static std::vector<std::string> ReadLines(const char* path) {
+	std::ifstream in(path);
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(in, line)) {
+		lines.push_back(line);
+	}
+	return lines;
+}
 
 static void test1() {
-	EASY_TRACE(TRACE, test1);
+	TRACE(TRACING, test1);
 
 	LOG_INFO(TEST, "Hi!" << 42);
 }
 
 static void test2() {
-	EASY_TRACE(TRACE, test1);
+	TRACE(TRACING, test2);
 
 	LOG_DEBUG(TEST, "don't show me");
 }
 
+static void test_disk_guard() {
+	const char* path = "test-bin-guard.log";
+	std::remove(path);
+	easylogger::Logger log("GUARD");
+	Quiet(log);
+	log.Level(easylogger::LEVEL_TRACE);
+	{
+		easylogger::FileSink file(path);
+		EXPECT(file.IsOpen(), "log file not opened");
+		log.Output(file);
+
+		// thresholds placed around the space actually free, far enough
+		// apart that other writers do not move it across a step
+		struct statvfs st;
+		EXPECT(::statvfs(path, &st) == 0, "statvfs failed");
+		const unsigned long long avail =
+				static_cast<unsigned long long>(st.f_bavail) * st.f_frsize;
+		file.DiskGuard(avail / 2, avail / 4);
+		EXPECT(file.MinLevel() == easylogger::LEVEL_TRACE,
+				"guard active above the low threshold");
+
+		// DEBUG through ERROR each take a fifth of the range
+		file.DiskGuard(avail + avail / 4, avail / 4);
+		EXPECT(file.MinLevel() == easylogger::LEVEL_INFO,
+				"wrong level a quarter of the way to critical");
+		LOG_DEBUG(log, "debug dropped");
+		LOG_INFO(log, "info kept");
+		file.DiskGuard(avail + avail * 3 / 4, avail * 3 / 4);
+		EXPECT(file.MinLevel() == easylogger::LEVEL_ERROR,
+				"wrong level three quarters of the way to critical");
+		LOG_WARNING(log, "warning dropped");
+		LOG_ERROR(log, "error kept");
+
+		file.DiskGuard(avail * 2, avail * 2);
+		EXPECT(file.MinLevel() == easylogger::LEVEL_FATAL,
+				"guard inactive below the critical threshold");
+		LOG_ERROR(log, "error dropped");
+		EXPECT(file.Dropped() == 3, "dropped records not counted");
+
+		file.DiskGuard(0, 0);
+		EXPECT(file.MinLevel() == easylogger::LEVEL_TRACE,
+				"disabled guard still dropping");
+		LOG_TRACE(log, "trace kept");
+		log.DetachOutput();
+	}
+	const std::vector<std::string> lines = ReadLines(path);
+	EXPECT(lines.size() == 3 && lines[0] == "info kept" &&
+			lines[1] == "error kept" && lines[2] == "trace kept",
+			"wrong records dropped");
+	std::remove(path);
+
+	// /dev/full reports free space but fails every write with ENOSPC
+	{
+		easylogger::FileSink full("/dev/full");
+		EXPECT(full.IsOpen(), "/dev/full not opened");
+		full.DiskGuard(1, 1);
+		full.SampleEvery(4, 1 << 20);
+		EXPECT(full.MinLevel() == easylogger::LEVEL_TRACE,
+				"/dev/full reports no space");
+		log.Output(full);
+		LOG_INFO(log, "no space");
+		EXPECT(full.MinLevel() == easylogger::LEVEL_FATAL,
+				"ENOSPC did not make the guard critical");
+		LOG_ERROR(log, "dropped without a write");
+		LOG_ERROR(log, "dropped without a write");
+		EXPECT(full.Dropped() == 3, "dropped records not counted");
+
+		// the fourth record samples again, finds space, and fails again
+		LOG_INFO(log, "no space");
+		EXPECT(full.Dropped() == 4 &&
+				full.MinLevel() == easylogger::LEVEL_FATAL,
+				"guard not resampled after ENOSPC");
+		log.DetachOutput();
+	}
+}
+
+static void test_sketch() {
+	char text[easylogger::TemplateSketch::MAX_TEMPLATE + 1];
+	easylogger::TemplateSketch::Fingerprint(
+			"user 42 logged in from 10.0.0.7", text);
+	EXPECT(std::strcmp(text, "user # logged in from #.#.#.#") == 0,
+			"numbers not masked");
+	easylogger::TemplateSketch::Fingerprint("id deadbeef12 cafe 0x1F a1b2",
+			text);
+	EXPECT(std::strcmp(text, "id # cafe # a1b2") == 0,
+			"identifiers not masked, or words masked");
+
+	easylogger::Logger log("SKETCH");
+	Quiet(log);
+	std::ostringstream report;
+	Collect collect;
+	{
+		easylogger::TemplateSketch sketch(std::chrono::seconds(3600),
+				&collect);
+		sketch.Report(&report);
+		log.Output(sketch);
+
+		// more distinct templates than the table holds, each seen once,
+		// do not push out the heavy ones
+		for (int i = 0; i != 5; ++i) {
+			LOG_INFO(log, "user " << i << " logged in");
+		}
+		for (int i = 0; i != 3; ++i) {
+			LOG_INFO(log, "disk " << i << " full");
+		}
+		for (int i = 0; i != easylogger::TemplateSketch::TOP_K + 8; ++i) {
+			LOG_INFO(log, "rare" << static_cast<char>('a' + i % 26)
+					<< static_cast<char>('a' + i / 26));
+		}
+		EXPECT(collect.lines.size() == 48 && collect.lines[0] ==
+				"user 0 logged in\n", "records not passed on");
+		EXPECT(report.str().empty(), "summary before the interval ended");
+
+		sketch.Flush();
+		std::vector<std::string> lines;
+		std::istringstream in(report.str());
+		for (std::string line; std::getline(in, line); ) {
+			lines.push_back(line);
+		}
+		EXPECT(lines.size() == 1 + easylogger::TemplateSketch::TOP_K &&
+				lines[0] == "top message templates of 48 records:" &&
+				lines[1] == "           5  user # logged in" &&
+				lines[2] == "           3  disk # full",
+				"wrong summary on Flush");
+
+		report.str("");
+		sketch.Flush();
+		EXPECT(report.str().empty(), "empty interval summarized");
+
+		LOG_INFO(log, "user 7 logged in");
+		log.DetachOutput();
+	}
+	EXPECT(report.str() == "top message templates of 1 records:\n"
+			"           1  user # logged in\n",
+			"last interval not summarized on destruction");
+}
+
+//! Log a value from a statement of its own
+static void Measure(easylogger::Logger& log, int value) {
+	LOG_VALUE(log, easylogger::LEVEL_INFO, value, "value " << value);
+}
+
+//! Log from a statement of its own
+static void Counted(easylogger::Logger& log) {
+	LOG_INFO(log, "counted");
+}
+
+//! Check that a summary line has the given count and value aggregate
+static bool IsSummary(const std::string& line, const char* count,
+		const char* values) {
+	const std::string prefix = std::string("[summary] ") + count +
+			" records in ";
+	const std::string suffix = std::string("ms") + values + "\n";
+	return line.compare(0, prefix.size(), prefix) == 0 &&
+			line.size() >= prefix.size() + suffix.size() &&
+			line.compare(line.size() - suffix.size(), suffix.size(),
+			suffix) == 0;
+}
+
+static void test_summarize() {
+	easylogger::SummaryInterval(3600000);
+	easylogger::Logger log("SUMMARY");
+	Quiet(log);
+	Collect collect;
+	log.Output(collect);
+
+	Measure(log, 1);
+	Counted(log);
+	easylogger::Summarize("st.cc", 0, true);
+	Measure(log, 2);
+	EXPECT(collect.lines.size() == 3 && collect.lines[2] == "value 2\n",
+			"file matched in the middle of a path component");
+
+	easylogger::Summarize("test.cc", 0, true);
+	Measure(log, 3);
+	Measure(log, 5);
+	Measure(log, 10);
+	Counted(log);
+	Counted(log);
+	EXPECT(collect.lines.size() == 3, "summarized records written");
+
+	easylogger::FlushSummaries();
+	EXPECT(collect.lines.size() == 5, "summaries not flushed");
+	const bool value_first = collect.lines[3].find("value") !=
+			std::string::npos;
+	EXPECT(IsSummary(collect.lines[value_first ? 3 : 4], "3",
+			", value min 3 max 10 mean 6"), "wrong value summary");
+	EXPECT(IsSummary(collect.lines[value_first ? 4 : 3], "2", ""),
+			"wrong count summary");
+
+	// switching the whole file back writes what is pending
+	Measure(log, 4);
+	easylogger::Summarize("test.cc", 0, false);
+	EXPECT(collect.lines.size() == 6 && IsSummary(collect.lines[5], "1",
+			", value min 4 max 4 mean 4"), "pending summary lost");
+	Measure(log, 6);
+	Counted(log);
+	EXPECT(collect.lines.size() == 8 && collect.lines[6] == "value 6\n" &&
+			collect.lines[7] == "counted\n", "file not switched back");
+	log.DetachOutput();
+
+	// summaries still pending at exit are written
+	const char* path = "test-bin-summary.log";
+	std::remove(path);
+	const pid_t child = ::fork();
+	EXPECT(child >= 0, "fork failed");
+	if (child == 0) {
+		// never freed: both must still be alive when the summaries are
+		// written at exit
+		easylogger::Logger* exiting = new easylogger::Logger("EXITING");
+		Quiet(*exiting);
+		exiting->Output(*new easylogger::FileSink(path));
+		easylogger::Summarize("test.cc", 0, true);
+		Measure(*exiting, 7);
+		Measure(*exiting, 9);
+		std::exit(0);
+	}
+	int status = 0;
+	EXPECT(::waitpid(child, &status, 0) == child && WIFEXITED(status) &&
+			WEXITSTATUS(status) == 0, "child failed");
+	const std::vector<std::string> lines = ReadLines(path);
+	EXPECT(lines.size() == 1 && IsSummary(lines[0] + "\n", "2",
+			", value min 7 max 9 mean 8"), "summary not written at exit");
+	std::remove(path);
+	easylogger::SummaryInterval(10000);
+}
+
+static void test_slow_scope() {
+	easylogger::Logger log("SLOW");
+	Quiet(log);
+	log.Level(easylogger::LEVEL_TRACE);
+	Collect collect;
+	log.Output(collect);
+
+	{
+		SLOW_SCOPE(log, fast, 1000000000);
+	}
+	{
+		SLOW_SCOPE(log, slow, 1000);
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	EXPECT(collect.lines.size() == 1 &&
+			collect.lines[0].compare(0, 10, "Slow slow:") == 0 &&
+			collect.lines[0].find("us (limit 1000us)\n") != std::string::npos,
+			"threshold not applied");
+
+	// slow inner scopes are logged and noted on the outer one, the
+	// first MAX_NOTES by name
+	collect.lines.clear();
+	{
+		SLOW_SCOPE(log, outer, 0);
+		{
+			SLOW_SCOPE(log, quick, 1000000000);
+		}
+		for (int i = 0; i != easylogger::_private::SlowScope::MAX_NOTES + 2;
+				++i) {
+			SLOW_SCOPE(log, inner, 0);
+		}
+	}
+	const std::size_t inner = easylogger::_private::SlowScope::MAX_NOTES + 2;
+	EXPECT(collect.lines.size() == inner + 1, "inner scopes not logged");
+	const std::string& outer = collect.lines[inner];
+	EXPECT(outer.compare(0, 11, "Slow outer:") == 0 &&
+			outer.find("quick") == std::string::npos &&
+			outer.find("; slow: inner ") != std::string::npos &&
+			outer.find(", 2 more\n") != std::string::npos,
+			"inner scopes not noted");
+	std::size_t named = 0;
+	for (std::size_t pos = outer.find("inner "); pos != std::string::npos;
+			pos = outer.find("inner ", pos + 1)) {
+		++named;
+	}
+	EXPECT(named == easylogger::_private::SlowScope::MAX_NOTES,
+			"wrong number of inner scopes named");
+
+	// the level is that of the statement
+	collect.lines.clear();
+	log.Level(easylogger::LEVEL_ERROR);
+	{
+		SLOW_SCOPE(log, warning, 0);
+	}
+	{
+		SLOW_SCOPE_LEVEL(log, easylogger::LEVEL_ERROR, error, 0);
+	}
+	EXPECT(collect.lines.size() == 1 &&
+			collect.lines[0].compare(0, 11, "Slow error:") == 0,
+			"level not applied");
+	log.DetachOutput();
+}
+
+static void test_find_logger() {
+	easylogger::Logger unused("UNUSED");
+	EXPECT(easylogger::FindLogger("UNUSED") == 0, "unused Logger found");
+	EXPECT(easylogger::FindLogger("EARLY.CHILD") == 0 &&
+			easylogger::FindLogger("EARLY") == 0,
+			"Loggers found before they were used");
+
+	// the child reaches the parent defined after it
+	EARLY.Format("%N %S");
+	EARLY.DetachStream();
+	EARLY_CHILD.DetachStream();
+	Collect collect;
+	EARLY.Output(collect);
+	LOG_INFO(EARLY_CHILD, "from the child");
+	EXPECT(collect.lines.size() == 1 &&
+			collect.lines[0] == "EARLY.CHILD from the child\n",
+			"child record not passed to its parent");
+
+	EXPECT(easylogger::FindLogger("EARLY.CHILD") == &EARLY_CHILD,
+			"child not found by its dotted name");
+	EXPECT(easylogger::FindLogger("EARLY") == &EARLY, "parent not found");
+	EXPECT(easylogger::FindLogger("CHILD") == 0,
+			"found by part of a dotted name");
+
+	unused.Level(easylogger::LEVEL_ERROR);
+	EXPECT(easylogger::FindLogger("UNUSED") == &unused,
+			"Logger not found once its level was set");
+	EARLY.DetachOutput();
+}
+
+//! Calls of dladdr(), which resolves the frames of captured stacks
+static std::atomic<int> dladdr_calls(0);
+
+extern "C" int dladdr(const void* address, Dl_info* info) noexcept {
+	typedef int (*Resolve)(const void*, Dl_info*);
+	static const Resolve resolve = reinterpret_cast<Resolve>(
+			::dlsym(RTLD_NEXT, "dladdr"));
+	++dladdr_calls;
+	return resolve(address, info);
+}
+
+//! Log with a stack; exported, so that the frame is named
+extern "C" __attribute__((noinline)) void log_with_stack(
+		easylogger::Logger& log) {
+	LOG_ERROR(log, "with stack");
+	__asm__ __volatile__("");
+}
+
+static void test_backtrace() {
+	easylogger::Logger log("STACK");
+	Quiet(log);
+	Collect collect;
+	log.Output(collect);
+	log.Backtrace(easylogger::LEVEL_ERROR);
+
+	LOG_WARNING(log, "no stack");
+	// one call site, so that the second stack is the same as the first
+	const int before = dladdr_calls.load();
+	int calls[2];
+	volatile int repeat = 2;
+	for (int i = 0; i != repeat; ++i) {
+		log_with_stack(log);
+		calls[i] = dladdr_calls.load();
+	}
+	EXPECT(collect.lines.size() == 3 && collect.lines[0] == "no stack\n",
+			"stack captured below the backtrace level");
+
+	// the innermost frame is the function logging, not Logger::Log
+	const std::string& first = collect.lines[1];
+	const std::string innermost = "with stack\n\t#0 log_with_stack+0x";
+	EXPECT(first.compare(0, innermost.size(), innermost) == 0,
+			"wrong innermost frame");
+	EXPECT(first.find("\n\t#1 ") != std::string::npos,
+			"outer frames not captured");
+	EXPECT(first.find("easylogger") == std::string::npos,
+			"frames inside easylogger captured");
+
+	// the same frames again are resolved from the cache
+	EXPECT(calls[0] > before && calls[1] == calls[0] &&
+			collect.lines[2] == first, "resolved frames not cached");
+	log.DetachOutput();
+}
+
+//! Key of a record: its message up to the first ':'
+static void MessageKey(const easylogger::LogRecord& record, std::string& key) {
+	const char* end = std::strchr(record.message, ':');
+	key.assign(record.message, end != 0 ? end - record.message :
+			std::strlen(record.message));
+}
+
+//! Get the whole text of a file
+static std::string ReadFile(const std::string& path) {
+	std::ifstream in(path.c_str());
+	std::ostringstream text;
+	text << in.rdbuf();
+	return text.str();
+}
+
+static void test_keyed() {
+	const char* keys[] = { "a", "b", "c", "big", "___x", "__", "x_y" };
+	std::vector<std::string> paths;
+	for (std::size_t i = 0; i != sizeof(keys) / sizeof(keys[0]); ++i) {
+		paths.push_back(std::string("test-bin-keyed-") + keys[i] + ".log");
+		std::remove(paths.back().c_str());
+	}
+	easylogger::Logger log("KEYED");
+	Quiet(log);
+	{
+		// at most two files open; the least recently written is closed,
+		// writing out its buffer
+		easylogger::KeyedFileSink sink("test-bin-keyed-%K.log", MessageKey);
+		sink.Limits(2, 64, 1024);
+		log.Output(sink);
+		LOG_INFO(log, "a:1");
+		LOG_INFO(log, "b:1");
+		LOG_INFO(log, "a:2");
+		EXPECT(ReadFile(paths[0]).empty() && ReadFile(paths[1]).empty(),
+				"records not buffered");
+		LOG_INFO(log, "c:1");
+		EXPECT(sink.OpenFiles() == 2, "open file limit exceeded");
+		EXPECT(ReadFile(paths[1]) == "b:1\n", "closed file not written out");
+		EXPECT(ReadFile(paths[0]).empty(), "recently used file closed");
+		LOG_INFO(log, "b:2");
+		EXPECT(ReadFile(paths[0]) == "a:1\na:2\n",
+				"closed file not written out");
+
+		// a record larger than the buffer goes straight to the file,
+		// after the records buffered before it
+		LOG_INFO(log, "big:1");
+		LOG_INFO(log, "big:" << std::string(100, 'x'));
+		EXPECT(ReadFile(paths[3]) == "big:1\nbig:" + std::string(100, 'x') +
+				"\n", "large record not written in order");
+
+		// keys cannot leave the template's directory
+		LOG_INFO(log, "../x:1");
+		LOG_INFO(log, "..:1");
+		LOG_INFO(log, "x/y:1");
+		log.DetachOutput();
+	}
+	EXPECT(ReadFile(paths[4]) == "../x:1\n" && ReadFile(paths[5]) == "..:1\n" &&
+			ReadFile(paths[6]) == "x/y:1\n", "unsafe key not replaced");
+	for (std::size_t i = 0; i != paths.size(); ++i) {
+		std::remove(paths[i].c_str());
+	}
+
+	{
+		// buffers of 64 bytes within 128 in total: a third buffer
+		// writes out and releases the least recently written one,
+		// leaving its file open
+		easylogger::KeyedFileSink sink("test-bin-keyed-%K.log", MessageKey);
+		sink.Limits(8, 64, 128);
+		log.Output(sink);
+		LOG_INFO(log, "a:1");
+		LOG_INFO(log, "b:1");
+		LOG_INFO(log, "c:1");
+		EXPECT(sink.OpenFiles() == 3, "file closed below the limit");
+		EXPECT(ReadFile(paths[0]) == "a:1\n", "buffer cap exceeded");
+		EXPECT(ReadFile(paths[1]).empty() && ReadFile(paths[2]).empty(),
+				"buffer released below the cap");
+		sink.Flush();
+		EXPECT(ReadFile(paths[1]) == "b:1\n" && ReadFile(paths[2]) == "c:1\n",
+				"buffers not written out by Flush()");
+		EXPECT(sink.Dropped() == 0, "records dropped");
+		log.DetachOutput();
+	}
+	for (std::size_t i = 0; i != paths.size(); ++i) {
+		std::remove(paths[i].c_str());
+	}
+}
+
+static void test_batch() {
+	const char* path = "test-bin-batch.log";
+	std::remove(path);
+
+	// two sinks on one file, so the batch and the single records race
+	// to append, each with its own write()
+	std::thread batches([path] {
+		easylogger::FileSink file(path);
+		easylogger::Logger log("BATCH");
+		Quiet(log);
+		log.Output(file);
+		for (int b = 0; b != 200; ++b) {
+			LOG_BATCH(log, easylogger::LEVEL_INFO, rows);
+			for (int r = 0; r != 10; ++r) {
+				BATCH_LOG(rows, "batch " << b << " row " << r);
+			}
+		}
+		log.DetachOutput();
+	});
+	std::thread singles([path] {
+		easylogger::FileSink file(path);
+		easylogger::Logger log("SINGLE");
+		Quiet(log);
+		log.Output(file);
+		for (int i = 0; i != 2000; ++i) {
+			LOG_INFO(log, "single " << i);
+		}
+		log.DetachOutput();
+	});
+	batches.join();
+	singles.join();
+
+	const std::vector<std::string> lines = ReadLines(path);
+	EXPECT(lines.size() == 4000, "records lost");
+	int batch = 0;
+	for (std::size_t i = 0; i != lines.size(); ++i) {
+		if (lines[i].compare(0, 6, "batch ") != 0) {
+			continue;
+		}
+		for (int r = 0; r != 10; ++r) {
+			std::ostringstream expected;
+			expected << "batch " << batch << " row " << r;
+			EXPECT(i + r < lines.size() && lines[i + r] == expected.str(),
+					"batch split");
+		}
+		++batch;
+		i += 9;
+	}
+	EXPECT(batch == 200, "batches lost");
+	std::remove(path);
+}
+
+static void test_shared_buffer() {
+	const char* path = "test-bin-shared.log";
+	std::remove(path);
+	{
+		easylogger::SharedBufferSink file(path, 256);
+		std::thread threads[2];
+		for (int t = 0; t != 2; ++t) {
+			threads[t] = std::thread([&file, t] {
+				easylogger::Logger log("SHARED");
+				Quiet(log);
+				log.Output(file);
+				for (int i = 0; i != 2000; ++i) {
+					LOG_INFO(log, "thread " << t << " n=" << i);
+				}
+				log.DetachOutput();
+			});
+		}
+		threads[0].join();
+		threads[1].join();
+	}
+
+	// records of each thread keep their order
+	const std::vector<std::string> lines = ReadLines(path);
+	EXPECT(lines.size() == 4000, "records lost");
+	int next[2] = { 0, 0 };
+	for (std::size_t i = 0; i != lines.size(); ++i) {
+		int t, n;
+		EXPECT(std::sscanf(lines[i].c_str(), "thread %d n=%d", &t, &n) == 2 &&
+				(t == 0 || t == 1), "record garbled");
+		EXPECT(n == next[t]++, "records reordered");
+	}
+	std::remove(path);
+}
+
+static std::string Inflate(const char* path) {
+	std::string text;
+	gzFile in = gzopen(path, "rb");
+	EXPECT(in != 0, "gzip file missing");
+	char buf[4096];
+	int rs;
+	while ((rs = gzread(in, buf, sizeof(buf))) > 0) {
+		text.append(buf, rs);
+	}
+	EXPECT(rs == 0, "gzip file corrupt");
+	gzclose(in);
+	return text;
+}
+
+static void test_gzip_recover() {
+	const char* path = "test-bin-recover.log.gz";
+	std::remove(path);
+	std::remove("test-bin-recover.log.gz.idx");
+	easylogger::Logger log("GZIP");
+	Quiet(log);
+	{
+		easylogger::GzipFileSink file(path);
+		log.Output(file);
+		LOG_INFO(log, "before crash");
+		log.DetachOutput();
+	}
+
+	// a block cut short by a crash: written, but never indexed
+	{
+		std::ofstream out(path, std::ios::app | std::ios::binary);
+		out.write("\x1f\x8b\x08\x00partial", 11);
+	}
+
+	{
+		easylogger::GzipFileSink file(path);
+		log.Output(file);
+		LOG_INFO(log, "after crash");
+		log.DetachOutput();
+	}
+	EXPECT(Inflate(path) == "before crash\nafter crash\n",
+			"partial block kept");
+	std::remove(path);
+	std::remove("test-bin-recover.log.gz.idx");
+}
+
+static void test_gzip_index() {
+	const char* path = "test-bin-index.log.gz";
+	const char* index = "test-bin-index.log.gz.idx";
+	std::remove(path);
+	std::remove(index);
+	easylogger::Logger log("GZIP");
+	Quiet(log);
+	{
+		easylogger::GzipFileSink file(path);
+		file.Blocks(1, std::chrono::seconds(5));
+		log.Output(file);
+		for (int i = 0; i != 4; ++i) {
+			LOG_INFO(log, "n=" << i);
+		}
+		log.DetachOutput();
+	}
+	const std::vector<std::string> lines = ReadLines(index);
+	EXPECT(lines.size() == 4, "a block per record not indexed");
+
+	// an index cut short in its third line: the blocks after the
+	// second are found again, with the same index lines
+	EXPECT(::truncate(index, lines[0].size() + lines[1].size() + 7) == 0,
+			"truncate failed");
+	{
+		easylogger::GzipFileSink file(path);
+		log.Output(file);
+		LOG_INFO(log, "n=4");
+		log.DetachOutput();
+	}
+	EXPECT(Inflate(path) == Numbered(0, 5), "blocks lost with the index");
+	const std::vector<std::string> rebuilt = ReadLines(index);
+	EXPECT(rebuilt.size() == 5 &&
+			std::equal(lines.begin(), lines.end(), rebuilt.begin()),
+			"index not rebuilt after a partial line");
+
+	// a missing index is rebuilt from the whole file
+	std::remove(index);
+	{
+		easylogger::GzipFileSink file(path);
+		log.Output(file);
+		LOG_INFO(log, "n=5");
+		log.DetachOutput();
+	}
+	EXPECT(Inflate(path) == Numbered(0, 6), "log lost without an index");
+	const std::vector<std::string> again = ReadLines(index);
+	EXPECT(again.size() == 6 &&
+			std::equal(rebuilt.begin(), rebuilt.end(), again.begin()),
+			"missing index not rebuilt");
+	std::remove(path);
+	std::remove(index);
+}
+
+static void test_failover() {
+	Collect primary, fallback;
+	easylogger::FailoverSink sink(primary, &fallback);
+	sink.Deadline(std::chrono::milliseconds(100), 1);
+	sink.Spill(1 << 20, std::chrono::milliseconds(10));
+	easylogger::Logger log("FAILOVER");
+	Quiet(log);
+	log.Output(sink);
+
+	for (int i = 0; i != 10; ++i) {
+		LOG_INFO(log, "n=" << i);
+	}
+	primary.fail = true;
+	for (int i = 10; i != 30; ++i) {
+		LOG_INFO(log, "n=" << i);
+	}
+	EXPECT(sink.Failed(), "primary not failed over");
+	{
+		std::lock_guard<std::mutex> guard(fallback.lock);
+		EXPECT(fallback.lines.size() == 20, "fallback missed records");
+	}
+
+	// the watchdog replays the spill in order once the primary is back
+	primary.fail = false;
+	for (int i = 0; i != 500 && sink.Failed(); ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	EXPECT(!sink.Failed(), "primary not recovered");
+	for (int i = 30; i != 40; ++i) {
+		LOG_INFO(log, "n=" << i);
+	}
+	{
+		std::lock_guard<std::mutex> guard(primary.lock);
+		EXPECT(InOrder(primary.lines, 40), "replay out of order");
+	}
+	log.DetachOutput();
+}
+
+static void test_async() {
+	Collect output;
+	easylogger::AsyncSink sink(output, easylogger::WAKE_SPIN_SLEEP,
+			std::chrono::microseconds(50), 8);
+	easylogger::Logger log("ASYNC");
+	Quiet(log);
+	log.Output(sink);
+	for (int i = 0; i != 2000; ++i) {
+		LOG_INFO(log, "n=" << i);
+	}
+	sink.Flush();
+	{
+		std::lock_guard<std::mutex> guard(output.lock);
+		EXPECT(InOrder(output.lines, 2000), "async out of order");
+	}
+	log.DetachOutput();
+}
+
+static void test_parallel() {
+	Collect first, second;
+	easylogger::ParallelSink sink(2, easylogger::WAKE_SPIN_SLEEP,
+			std::chrono::microseconds(50), 16);
+	sink.Add(first);
+	sink.Add(second);
+	easylogger::Logger log("PARALLEL");
+	Quiet(log);
+	log.Output(sink);
+	for (int i = 0; i != 2000; ++i) {
+		LOG_INFO(log, "n=" << i);
+	}
+	sink.Flush();
+	{
+		std::lock_guard<std::mutex> guard(first.lock);
+		EXPECT(InOrder(first.lines, 2000), "parallel out of order");
+	}
+	{
+		std::lock_guard<std::mutex> guard(second.lock);
+		EXPECT(InOrder(second.lines, 2000), "parallel out of order");
+	}
+	log.DetachOutput();
+}
+
+static void test_destroyed_logger() {
+	Collect output;
+	output.hold = true;
+	easylogger::AsyncSink sink(output);
+	{
+		// the Logger borrows its name, which dies with it
+		char name[] = "conn-7";
+		{
+			easylogger::Logger log(name);
+			Quiet(log);
+			log.Output(sink);
+			for (int i = 0; i != 10; ++i) {
+				LOG_INFO(log, "n=" << i);
+			}
+		}
+		std::memset(name, 'x', sizeof(name) - 1);
+	}
+	output.hold = false;
+	sink.Flush();
+
+	std::lock_guard<std::mutex> guard(output.lock);
+	EXPECT(InOrder(output.lines, 10), "queued records lost");
+	for (std::size_t i = 0; i != output.names.size(); ++i) {
+		EXPECT(output.names[i] == "conn-7", "name not copied");
+	}
+}
+
+#if EASYLOGGER_HAVE_PMR
+//! Memory resource counting the allocations passed on to another
+struct Counting : std::pmr::memory_resource {
+	explicit Counting(std::pmr::memory_resource& upstream) :
+			upstream(upstream), allocations(0) {}
+
+	void* do_allocate(std::size_t bytes, std::size_t alignment) {
+		++allocations;
+		return upstream.allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* data, std::size_t bytes, std::size_t alignment) {
+		upstream.deallocate(data, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+		return this == &other;
+	}
+
+	std::pmr::memory_resource& upstream;
+	unsigned long allocations;
+};
+
+//! Sink counting records and bytes, without allocating
+struct Tally : easylogger::Sink {
+	Tally() : records(0), bytes(0) {}
+
+	bool Write(const easylogger::LogRecord&, const char*, std::size_t length) {
+		++records;
+		bytes += length;
+		return true;
+	}
+
+	unsigned long records;
+	std::size_t bytes;
+};
+
+static void test_memory() {
+	static char buffer[1 << 16];
+	std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+			std::pmr::null_memory_resource());
+	Counting memory(arena);
+	Tally output;
+	easylogger::Logger parent("MEMORY");
+	easylogger::Logger log("REQUEST", parent);
+	Quiet(parent);
+	parent.Memory(memory);
+	parent.Output(output);
+	log.Format("%S");
+	log.DetachStream();
+	const std::string text(1000, 'x');
+
+	// records longer than the inline buffer, and a batch, inherit the
+	// parent's resource
+	const unsigned long before = global_allocations.load();
+	LOG_INFO(log, "short " << 42);
+	LOG_INFO(log, text);
+	{
+		LOG_BATCH(log, easylogger::LEVEL_INFO, rows);
+		for (int r = 0; r != 3; ++r) {
+			BATCH_LOG(rows, "row " << r << ' ' << text);
+		}
+	}
+	EXPECT(global_allocations.load() == before,
+			"logging allocated from the global heap");
+	EXPECT(memory.allocations != 0, "memory resource unused");
+	EXPECT(output.records == 5, "records lost");
+	parent.DetachOutput();
+}
+
+#endif
+#if EASYLOGGER_HAVE_USDT
+static void test_probe() {
+	easylogger::Logger log("PROBE");
+	Quiet(log);
+	int formatted = 0;
+
+	// as a tracer attaching to easylogger:log does
+	easylogger_log_semaphore = 1;
+	LOG_INFO(log, "n=" << formatted++);
+	EXPECT(formatted == 1, "traced message formatted twice");
+	LOG_DEBUG(log, "n=" << formatted++);
+	EXPECT(formatted == 2, "traced message below the level not formatted");
+	easylogger_log_semaphore = 0;
+	LOG_DEBUG(log, "n=" << formatted++);
+	EXPECT(formatted == 2, "untraced message below the level formatted");
+}
+
+#endif
 int main() {
 	SUB.Level(easylogger::LEVEL_WARNING);
-	TRACE.Format("[%F:%C %P] %N: %S");
-	TRACE.Level(easylogger::LEVEL_TRACE);
+	TRACING.Format("[%F:%C %P] %N: %S");
+	TRACING.Level(easylogger::LEVEL_TRACE);
 
-	EASY_TRACE(TRACE, main);
+	TRACE(TRACING, main);
 
 	test1();
 	test2();
@@ -31,5 +1005,28 @@ int main() {
 	//LOG_FATAL(TEST, "dead");
 	//LOG_ERROR(TEST, "won't see me");
 
+	test_disk_guard();
+	test_keyed();
+	test_sketch();
+	test_summarize();
+	test_slow_scope();
+	test_find_logger();
+	test_backtrace();
+	test_batch();
+	test_shared_buffer();
+	test_gzip_recover();
+	test_gzip_index();
+	test_failover();
+	test_async();
+	test_parallel();
+	test_destroyed_logger();
+#if EASYLOGGER_HAVE_PMR
+	test_memory();
+#endif
+#if EASYLOGGER_HAVE_USDT
+	test_probe();
+#endif
+	LOG_INFO(CHECK, "all checks passed");
+
 	return 0;
 }